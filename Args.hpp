@@ -0,0 +1,24 @@
+#ifndef CHIP8LER__ARGS_HPP_
+#define CHIP8LER__ARGS_HPP_
+
+#include <charconv>
+#include <cstring>
+#include <type_traits>
+
+// The whole of `text` as a number, false instead of throwing when it is not one or does
+// not fit in `T`, so the tools can print their usage for a mistyped argument. Hex may
+// start with 0x, floating point `T` is read as a decimal
+template <class T>
+inline bool ParseArg(const char *text, T &value, int base = 10) {
+    if (base == 16 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) text += 2;
+
+    const char *end = text + strlen(text);
+    std::from_chars_result result;
+    if constexpr (std::is_floating_point_v<T>)
+        result = std::from_chars(text, end, value);
+    else
+        result = std::from_chars(text, end, value, base);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+#endif //CHIP8LER__ARGS_HPP_
@@ -0,0 +1,65 @@
+#include <iostream>
+
+#include "Audio.hpp"
+
+#define err(msg) std::cout << msg << ": " << SDL_GetError() << std::endl
+
+Audio::Audio(uint16_t buffer_samples) : device(0), buzzing(false), sample_rate(AUDIO_SAMPLE_RATE), phase(0) {
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        err("Failed to initialize SDL audio");
+        return;
+    }
+
+    SDL_AudioSpec desired = {};
+    desired.freq = AUDIO_SAMPLE_RATE;
+    desired.format = AUDIO_S16SYS;
+    desired.channels = 1;
+    desired.samples = buffer_samples;
+    desired.callback = &Audio::Callback;
+    desired.userdata = this;
+
+    SDL_AudioSpec obtained;
+    device = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (device == 0) {
+        err("Could not open audio device");
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return;
+    }
+
+    sample_rate = obtained.freq;
+    SDL_PauseAudioDevice(device, 0);
+}
+
+Audio::~Audio() {
+    if (device == 0) return;
+
+    SDL_CloseAudioDevice(device);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
+
+bool Audio::IsOpen() const {
+    return device != 0;
+}
+
+void Audio::SetBuzzing(bool buzzing) {
+    this->buzzing.store(buzzing, std::memory_order_relaxed);
+}
+
+void Audio::Callback(void *userdata, Uint8 *stream, int length) {
+    auto *audio = static_cast<Audio *>(userdata);
+    auto *samples = reinterpret_cast<int16_t *>(stream);
+    int count = length / sizeof(int16_t);
+
+    // the flag is read once per buffer, so a buffer is the shortest beep there can be
+    int16_t volume = audio->buzzing.load(std::memory_order_relaxed) ? BUZZER_VOLUME : 0;
+
+    // the phase keeps running through silence so the wave never restarts half way
+    uint32_t phase = audio->phase;
+    uint32_t rate = audio->sample_rate;
+    for (int i = 0; i < count; i++) {
+        samples[i] = phase < rate / 2 ? volume : -volume;
+        phase += BUZZER_FREQUENCY;
+        if (phase >= rate) phase -= rate;
+    }
+    audio->phase = phase;
+}
@@ -0,0 +1,36 @@
+#ifndef CHIP8LER__AUDIO_HPP_
+#define CHIP8LER__AUDIO_HPP_
+
+#include <SDL.h>
+#include <atomic>
+#include <cstdint>
+
+#define AUDIO_SAMPLE_RATE 44100
+#define AUDIO_DEFAULT_BUFFER 512  // samples per callback, smaller means less latency
+#define BUZZER_FREQUENCY 440      // Hz
+#define BUZZER_VOLUME 3000        // amplitude of the square wave, out of 32767
+
+// Square wave buzzer played while the sound timer is running. The emulation side only
+// stores an atomic flag and the SDL callback only loads it, so neither side ever waits
+// on the other and the callback does no locking or allocation.
+// Works with any SDL audio driver, SDL_AUDIODRIVER=disk writes the output to a file.
+class Audio {
+ public:
+    explicit Audio(uint16_t buffer_samples = AUDIO_DEFAULT_BUFFER);
+    ~Audio();
+
+    bool IsOpen() const;
+    void SetBuzzing(bool buzzing);
+
+ private:
+    SDL_AudioDeviceID device;
+    std::atomic<bool> buzzing;
+
+    // only touched by the callback once the device is running
+    int sample_rate;
+    uint32_t phase;  // position in the current period, in 1/sample_rate of a period
+
+    static void Callback(void *userdata, Uint8 *stream, int length);
+};
+
+#endif //CHIP8LER__AUDIO_HPP_
@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+
+#include "Capture.hpp"
+
+#define GIF_MAX_CODES 4096
+#define GIF_MIN_DELAY 2  // centiseconds, viewers slow anything shorter right down
+
+CaptureWriter::CaptureWriter() : running(false), head(0), tail(0), dropped(0), previous(), frames(0) {}
+
+CaptureWriter::~CaptureWriter() {
+    Close();
+}
+
+bool CaptureWriter::Open(const std::string &path) {
+    Close();
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open capture file: " << path << std::endl;
+        return false;
+    }
+
+    // counts are filled in on Close
+    CaptureHeader header = {CAPTURE_MAGIC, CAPTURE_VERSION, sizeof(CaptureRecord), 0, 0};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    memset(previous, 0, sizeof(previous));
+    frames = 0;
+    dropped = 0;
+    start = Clock::now();
+
+    running = true;
+    writer = std::thread(&CaptureWriter::Drain, this);
+    return true;
+}
+
+void CaptureWriter::Close() {
+    if (!writer.joinable()) return;
+
+    running.store(false, std::memory_order_release);
+    writer.join();
+
+    CaptureHeader header = {CAPTURE_MAGIC, CAPTURE_VERSION, sizeof(CaptureRecord), frames, dropped.load()};
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.close();
+}
+
+bool CaptureWriter::IsOpen() const {
+    return writer.joinable();
+}
+
+void CaptureWriter::Push(const Frame &frame) {
+    uint32_t position = head.load(std::memory_order_relaxed);
+    if (position - tail.load(std::memory_order_acquire) == CAPTURE_QUEUE_SIZE) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Entry &entry = ring[position & (CAPTURE_QUEUE_SIZE - 1)];
+    entry.frame = frame;
+    entry.microseconds = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    head.store(position + 1, std::memory_order_release);
+}
+
+void CaptureWriter::Drain() {
+    for (;;) {
+        // check for shutdown before looking at head, so nothing pushed before Close is lost
+        bool stopping = !running.load(std::memory_order_acquire);
+        uint32_t position = tail.load(std::memory_order_relaxed);
+        uint32_t available = head.load(std::memory_order_acquire) - position;
+
+        if (!available) {
+            if (stopping) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        for (uint32_t i = 0; i < available; i++)
+            Write(ring[(position + i) & (CAPTURE_QUEUE_SIZE - 1)]);
+        tail.store(position + available, std::memory_order_release);
+    }
+
+    file.flush();
+}
+
+void CaptureWriter::Write(const Entry &entry) {
+    uint64_t delta[HIRES_DISPLAY_HEIGHT][HIRES_DISPLAY_WIDTH / 64];
+    for (int y = 0; y < HIRES_DISPLAY_HEIGHT; y++) {
+        for (int w = 0; w < HIRES_DISPLAY_WIDTH / 64; w++) {
+            delta[y][w] = entry.frame.display[y][w] ^ previous[y][w];
+            previous[y][w] = entry.frame.display[y][w];
+        }
+    }
+
+    uint8_t payload[CAPTURE_MAX_PAYLOAD];
+    CaptureRecord record = {};
+    record.number = entry.frame.number;
+    record.microseconds = entry.microseconds;
+    record.size = EncodeDelta(reinterpret_cast<const uint8_t *>(delta), sizeof(delta), payload);
+    record.hires = entry.frame.hires;
+
+    file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    file.write(reinterpret_cast<const char *>(payload), record.size);
+    frames++;
+}
+
+bool CaptureReader::Open(const std::string &path) {
+    if (!file.Open(path)) {
+        std::cerr << "Failed to open capture file: " << path << std::endl;
+        return false;
+    }
+
+    if (file.Size() < sizeof(header)) {
+        std::cerr << "Not a chip8ler capture: " << path << std::endl;
+        return false;
+    }
+    memcpy(&header, file.Data(), sizeof(header));
+    if (header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION || header.record_size != sizeof(CaptureRecord)) {
+        std::cerr << "Not a chip8ler capture: " << path << std::endl;
+        return false;
+    }
+
+    position = sizeof(header);
+    memset(display, 0, sizeof(display));
+    return true;
+}
+
+const CaptureHeader &CaptureReader::Header() const {
+    return header;
+}
+
+bool CaptureReader::Next(Frame &frame, uint64_t &microseconds) {
+    CaptureRecord record;
+    if (position + sizeof(record) > file.Size()) return false;
+    memcpy(&record, file.Data() + position, sizeof(record));
+    if (position + sizeof(record) + record.size > file.Size()) return false;
+
+    const uint8_t *payload = file.Data() + position + sizeof(record);
+    if (!DecodeDelta(payload, record.size, reinterpret_cast<uint8_t *>(display), sizeof(display))) return false;
+    position += sizeof(record) + record.size;
+
+    memcpy(frame.display, display, sizeof(display));
+    frame.hires = record.hires;
+    frame.number = record.number;
+    microseconds = record.microseconds;
+    return true;
+}
+
+size_t EncodeDelta(const uint8_t *delta, size_t size, uint8_t *out) {
+    size_t written = 0;
+    for (size_t i = 0; i < size;) {
+        size_t run = 0;
+        while (i + run < size && run < 128 && !delta[i + run]) run++;
+        if (run) {
+            out[written++] = 0x80 | (run - 1);
+            i += run;
+            continue;
+        }
+
+        // literals up to the next two zeros in a row, a lone zero is cheaper to keep
+        size_t first = i;
+        while (i < size && i - first < 128 && (delta[i] || (i + 1 < size && delta[i + 1])))
+            i++;
+        out[written++] = i - first - 1;
+        memcpy(out + written, delta + first, i - first);
+        written += i - first;
+    }
+    return written;
+}
+
+bool DecodeDelta(const uint8_t *data, size_t size, uint8_t *display, size_t display_size) {
+    size_t position = 0;
+    for (size_t i = 0; i < size;) {
+        uint8_t control = data[i++];
+        size_t length = (control & 0x7F) + 1;
+        if (position + length > display_size) return false;
+
+        if (!(control & 0x80)) {
+            if (i + length > size) return false;
+            for (size_t k = 0; k < length; k++)
+                display[position + k] ^= data[i + k];
+            i += length;
+        }
+        position += length;
+    }
+    return true;
+}
+
+namespace {
+
+// LZW codes packed least significant bit first into GIF's sub-blocks of up to 255 bytes
+class GifCodeWriter {
+ public:
+    explicit GifCodeWriter(std::ostream &out) : out(out), bits(0), count(0) {}
+
+    void Write(uint32_t code, int width) {
+        bits |= code << count;
+        count += width;
+        while (count >= 8) {
+            Byte(bits & 0xFF);
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    void Finish() {
+        if (count) Byte(bits & 0xFF);
+        if (!block.empty()) Flush();
+        out.put(0);  // block terminator
+    }
+
+ private:
+    std::ostream &out;
+    uint32_t bits;
+    int count;
+    std::vector<uint8_t> block;
+
+    void Byte(uint8_t byte) {
+        block.push_back(byte);
+        if (block.size() == 255) Flush();
+    }
+
+    void Flush() {
+        out.put(char(block.size()));
+        out.write(reinterpret_cast<const char *>(block.data()), block.size());
+        block.clear();
+    }
+};
+
+void Put16(std::ostream &out, uint16_t value) {
+    out.put(value & 0xFF);
+    out.put(value >> 8);
+}
+
+// one frame of 0 and 1 pixels, LZW compressed with a 2 bit minimum code size
+void WriteGifImage(std::ostream &out, const std::vector<uint8_t> &pixels, uint16_t width, uint16_t height, uint16_t delay) {
+    // graphic control extension: no disposal, `delay` centiseconds
+    out.put(0x21);
+    out.put(char(0xF9));
+    out.put(4);
+    out.put(0);
+    Put16(out, delay);
+    out.put(0);
+    out.put(0);
+
+    // image descriptor covering the whole screen, no local colour table
+    out.put(0x2C);
+    Put16(out, 0);
+    Put16(out, 0);
+    Put16(out, width);
+    Put16(out, height);
+    out.put(0);
+
+    const int min_code_size = 2;
+    const uint16_t clear = 1 << min_code_size;
+    const uint16_t end = clear + 1;
+    out.put(min_code_size);
+
+    // codes for a prefix followed by a 0 or a 1 pixel, 0 where there is none yet
+    std::vector<std::array<uint16_t, 2>> next(GIF_MAX_CODES);
+    uint16_t codes = end + 1;
+    int width_bits = min_code_size + 1;
+
+    GifCodeWriter writer(out);
+    writer.Write(clear, width_bits);
+
+    uint16_t prefix = pixels[0];
+    for (size_t i = 1; i < pixels.size(); i++) {
+        uint8_t pixel = pixels[i];
+        if (next[prefix][pixel]) {
+            prefix = next[prefix][pixel];
+            continue;
+        }
+
+        writer.Write(prefix, width_bits);
+        if (codes < GIF_MAX_CODES) {
+            next[prefix][pixel] = codes++;
+            if (codes > (1u << width_bits) && width_bits < 12) width_bits++;
+        } else {
+            // table full, start over
+            writer.Write(clear, width_bits);
+            std::fill(next.begin(), next.end(), std::array<uint16_t, 2>{});
+            codes = end + 1;
+            width_bits = min_code_size + 1;
+        }
+        prefix = pixel;
+    }
+
+    writer.Write(prefix, width_bits);
+    writer.Write(end, width_bits);
+    writer.Finish();
+}
+
+}
+
+bool WriteCaptureGif(CaptureReader &reader, std::ostream &out, int scale) {
+    uint16_t width = HIRES_DISPLAY_WIDTH * scale;
+    uint16_t height = HIRES_DISPLAY_HEIGHT * scale;
+
+    // header, screen with a two colour global table, and looping forever
+    out.write("GIF89a", 6);
+    Put16(out, width);
+    Put16(out, height);
+    out.put(char(0x80));
+    out.put(0);
+    out.put(0);
+    const uint8_t colors[6] = {0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF};
+    out.write(reinterpret_cast<const char *>(colors), sizeof(colors));
+    out.write("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19);
+
+    auto render = [&](const Frame &frame, std::vector<uint8_t> &pixels) {
+        int size = frame.hires ? scale : scale * 2;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int px = x / size, py = y / size;
+                pixels[y * width + x] = frame.display[py][px / 64] >> (63 - px % 64) & 0x1;
+            }
+        }
+    };
+
+    // a frame is written once the next one says how long it stayed up. Frames shown for
+    // less than GIF_MIN_DELAY are replaced by the next one
+    std::vector<uint8_t> pending(size_t(width) * height);
+    uint64_t pending_cs = 0;
+    bool have_pending = false;
+    uint64_t written = 0;
+
+    Frame frame;
+    uint64_t microseconds;
+    while (reader.Next(frame, microseconds)) {
+        uint64_t cs = microseconds / 10000;
+        if (have_pending && cs - pending_cs >= GIF_MIN_DELAY) {
+            WriteGifImage(out, pending, width, height, std::min<uint64_t>(cs - pending_cs, 0xFFFF));
+            written++;
+            pending_cs = cs;
+        } else if (!have_pending) {
+            pending_cs = cs;
+        }
+
+        render(frame, pending);
+        have_pending = true;
+    }
+
+    if (have_pending) {
+        WriteGifImage(out, pending, width, height, GIF_MIN_DELAY);
+        written++;
+    }
+
+    out.put(0x3B);
+    return written && out.good();
+}
@@ -0,0 +1,110 @@
+#ifndef CHIP8LER__CAPTURE_HPP_
+#define CHIP8LER__CAPTURE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Chip8.hpp"
+#include "MappedFile.hpp"
+
+#define CAPTURE_MAGIC 0x50433843  // "C8CP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_QUEUE_SIZE 64  // frames, must be a power of two. About a second at 60 Hz
+#define CAPTURE_MAX_PAYLOAD (sizeof(Frame::display) + sizeof(Frame::display) / 128 + 1)  // bytes, a screen of literals
+
+// frames written and dropped are filled in when the capture is closed
+struct CaptureHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint64_t frames;
+    uint64_t dropped;  // frames the writer thread could not keep up with
+};
+
+// one presented frame, followed by `size` bytes of payload: the display XORed with the
+// frame before, as a run of zeros or of up to 128 literal bytes after each control byte
+struct CaptureRecord {
+    uint64_t number;        // Frame::number, gaps are frames the emulator skipped or dropped
+    uint64_t microseconds;  // since the capture was opened
+    uint16_t size;
+    uint8_t hires;
+    uint8_t reserved[5];
+};
+
+static_assert(sizeof(CaptureHeader) == 24, "capture headers are written to disk as is");
+static_assert(sizeof(CaptureRecord) == 24, "capture records are written to disk as is");
+
+// Records every presented frame into a compact file. The emulation thread only copies
+// the frame into a bounded ring; diffing, compressing and writing happen on a background
+// thread. When the ring is full the frame is dropped and counted, the emulation thread
+// never waits.
+class CaptureWriter {
+ public:
+    CaptureWriter();
+    ~CaptureWriter();
+
+    bool Open(const std::string &path);
+    void Close();
+    bool IsOpen() const;
+
+    void Push(const Frame &frame);
+
+ private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        Frame frame;
+        uint64_t microseconds;
+    };
+
+    std::ofstream file;
+    std::thread writer;
+    std::atomic<bool> running;
+    Clock::time_point start;
+
+    Entry ring[CAPTURE_QUEUE_SIZE];
+    std::atomic<uint32_t> head;  // written by the emulation thread
+    std::atomic<uint32_t> tail;  // written by the writer thread
+    std::atomic<uint64_t> dropped;
+
+    // only used on the writer thread
+    uint64_t previous[HIRES_DISPLAY_HEIGHT][HIRES_DISPLAY_WIDTH / 64];
+    uint64_t frames;
+
+    void Drain();
+    void Write(const Entry &entry);
+};
+
+// Reads a capture back frame by frame
+class CaptureReader {
+ public:
+    bool Open(const std::string &path);
+
+    const CaptureHeader &Header() const;
+    // false at the end, or if the rest of the file is damaged
+    bool Next(Frame &frame, uint64_t &microseconds);
+
+ private:
+    MappedFile file;
+    CaptureHeader header;
+    size_t position;
+    uint64_t display[HIRES_DISPLAY_HEIGHT][HIRES_DISPLAY_WIDTH / 64];
+};
+
+// the delta payload format above. Encode returns the bytes written to `out`, which has
+// room for CAPTURE_MAX_PAYLOAD. Decode XORs the changes into `display`, false if they do
+// not fit
+size_t EncodeDelta(const uint8_t *delta, size_t size, uint8_t *out);
+bool DecodeDelta(const uint8_t *data, size_t size, uint8_t *display, size_t display_size);
+
+// animated GIF of all frames in a capture, each lores pixel twice as large as a hires one
+// so the picture keeps its size across mode switches
+bool WriteCaptureGif(CaptureReader &reader, std::ostream &out, int scale);
+
+#endif //CHIP8LER__CAPTURE_HPP_
@@ -1,23 +1,28 @@
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <algorithm>
 
 #include "Chip8.hpp"
+#include "Debugger.hpp"
+#include "Latency.hpp"
+#include "MappedFile.hpp"
+#include "Profile.hpp"
+#include "Recompiler.hpp"
+#include "Trace.hpp"
 
-using Clock=std::chrono::system_clock;
+using Clock=std::chrono::steady_clock;
 
-#define LOG_V(n) "V" << int(n) << " (0x" << int(V[n]) << ")"
-#define LOG_I "I (0x" << int(I) << ")"
-#define LOG_DT "DT (0x" << int(dt) << ")"
-#define LOG_ST "ST (0x" << int(st) << ")"
-#define LOG_CHANGED std::endl << "\t→ "
+// addresses past the end of memory wrap around instead of reading or writing out of bounds
+#define MEM(address) memory[(address) & (MEMORY_SIZE - 1)]
 
-// TODO: separate object construction from initialization
-Chip8::Chip8(bool debug) {
-    this->debug = debug;
+#define NO_IDLE_JUMP 0xFFFF
 
+// TODO: separate object construction from initialization
+Chip8::Chip8() {
     opcode = 0;
     I = 0;
-    pc = 0x200;  // programs start at 0x200 (512)
+    pc = PROGRAM_START;
     sp = 0;
     dt = 0;
     st = 0;
@@ -46,342 +51,962 @@ Chip8::Chip8(bool debug) {
         0xF0, 0x80, 0xF0, 0x80, 0x80,  // F
     };
 
+    // SuperCHIP digits are 8x10, A-F were not in the original and follow Octo
+    uint8_t big_font[] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF,  // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF,  // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,  // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,  // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03,  // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,  // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,  // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18,  // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF,  // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF,  // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3,  // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC,  // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C,  // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC,  // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF,  // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0,  // F
+    };
+
     for (int i = 0; i < sizeof(font); i++)
         memory[i] = font[i];
+    for (size_t i = 0; i < sizeof(big_font); i++)
+        memory[BIG_FONT_ADDRESS + i] = big_font[i];
 
-    // TODO: use proper seed
-    srand(1234);
+    RefreshDecoded(0, MEMORY_SIZE);
 }
 
 Chip8::~Chip8() = default;
 
 bool Chip8::LoadRom(const std::string& path) {
-    std::ifstream file(path);
-    if (!file.is_open()) {
+    MappedFile file;
+    if (!file.Open(path)) {
         std::cerr << "Failed to load rom: " << path << std::endl;
         return false;
     }
 
-    int i = 0;
-    while (!file.eof()) {
-        memory[0x200 + i] = file.get();
-        i++;
+    if (!LoadRom(file.Data(), file.Size())) {
+        std::cerr << "Failed to load rom, " << file.Size() << " bytes is more than the "
+                  << MAX_ROM_SIZE << " that fit in memory: " << path << std::endl;
+        return false;
     }
 
-    file.close();
-
     return true;
 }
 
-void Chip8::Cycle() {
-    uint8_t high = memory[pc];
-    uint8_t low = memory[pc + 1];
-    opcode = high << 8 | low;
+bool Chip8::LoadRom(const uint8_t *data, size_t size) {
+    if (size > MAX_ROM_SIZE) return false;
 
-    uint16_t nnn = opcode & 0x0FFF;
-    uint8_t n = low & 0x0F;
-    uint8_t x = high & 0x0F;
-    uint8_t y = low >> 4 & 0x0F;
-    uint8_t kk = low;
+    // whatever an earlier rom left behind is cleared along with it
+    memcpy(memory + PROGRAM_START, data, size);
+    memset(memory + PROGRAM_START + size, 0, MAX_ROM_SIZE - size);
 
-    // delay timer and sound timer
-    auto now = Clock::now();
-    long duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - prev_timer_start).count();
+    RefreshDecoded(PROGRAM_START, MAX_ROM_SIZE);
 
-    if (duration > (1000 / 60)) {
-        if (dt > 0) dt--;
-        if (st > 0) st--;
-        prev_timer_start = Clock::now();
-    }
+    QuirkPreset preset = QuirkPreset::kCosmacVip;
+    LookupQuirks(data, size, preset);
+    SetQuirks(preset);
 
-    update_display = false;
+    return true;
+}
 
-    if (debug) {
-        std::cout << std::hex << std::uppercase;
-        std::cout << "pc:0x" << pc << " opcode:0x" << opcode << " inst:";
-    }
+Chip8::Instruction Chip8::Decode(uint16_t opcode) {
+    Instruction inst;
+    inst.opcode = opcode;
+    inst.x = opcode >> 8 & 0x0F;
+    inst.y = opcode >> 4 & 0x0F;
+    inst.n = opcode & 0x0F;
+    inst.kk = opcode & 0xFF;
+    inst.op = kNop;
 
     switch (opcode & 0xF000) {
         case 0x0000:
-            switch (low) {
-                case 0xE0:  // CLS - Clear screen
-                    if (debug) std::cout << "CLS";
-
-                    for (auto & rows : display) {
-                        for (uint8_t & point : rows) {
-                            point = 0x0;
-                        }
-                    }
-                    update_display = true;
-                    pc += 2;
-                    break;
-                case 0xEE:  // RET - Return from call
-                    if (debug) std::cout << "RET";
-
-                    pc = stack[--sp] + 2;
-                    break;
-                default:
-                    pc += 2;
-            }
-            break;
-        case 0x1000:  // JP nnn
-            if (debug) std::cout << "JP " << "0x" << nnn;
-            pc = nnn;
-            break;
-        case 0x2000:  // CALL nnn
-            if (debug) std::cout << "CALL " << "0x" << nnn;
-            stack[sp++] = pc;
-            pc = nnn;
-            break;
-        case 0x3000:  // SE Vx, kk
-            if (debug) std::cout << "SE " LOG_V(x) << ", " << "0x" << int(kk);
-            pc += V[x] == kk ? 4 : 2;
-            break;
-        case 0x4000:  // SNE Vx, kk
-            if (debug) std::cout << "SNE " << LOG_V(x) << ", " << "0x" << int(kk);
-            pc += V[x] != kk ? 4 : 2;
-            break;
-        case 0x5000:  // SE Vx, Vy
-            if (debug) std::cout << "SE " << LOG_V(x) << ", " << LOG_V(y);
-            pc += V[x] == V[y] ? 4 : 2;
-            break;
-        case 0x6000:  // LD Vx, kk
-            if (debug) std::cout << "LD " << LOG_V(x) << ", " << "0x" << int(kk);
-            V[x] = kk;
-            pc += 2;
-            if (debug) std::cout << LOG_CHANGED << LOG_V(x);
-            break;
-        case 0x7000:  // ADD Vx, kk
-            if (debug) std::cout << "ADD " << LOG_V(x) << ", " << "0x" << int(kk);
-            V[x] += kk;
-            pc += 2;
-            if (debug) std::cout << LOG_CHANGED << LOG_V(x);
+            if (inst.kk == 0xE0) inst.op = kCls;
+            else if (inst.kk == 0xEE) inst.op = kRet;
+            else if (inst.y == 0xC) inst.op = kScd;
+            else if (inst.kk == 0xFB) inst.op = kScr;
+            else if (inst.kk == 0xFC) inst.op = kScl;
+            else if (inst.kk == 0xFD) inst.op = kExit;
+            else if (inst.kk == 0xFE) inst.op = kLow;
+            else if (inst.kk == 0xFF) inst.op = kHigh;
             break;
+        case 0x1000: inst.op = kJp; break;
+        case 0x2000: inst.op = kCall; break;
+        case 0x3000: inst.op = kSeImm; break;
+        case 0x4000: inst.op = kSneImm; break;
+        case 0x5000: inst.op = kSeReg; break;
+        case 0x6000: inst.op = kLdImm; break;
+        case 0x7000: inst.op = kAddImm; break;
         case 0x8000:
-            switch (n) {
-                case 0x0:  // LD Vx, Vy
-                    if (debug) std::cout << "LD " << LOG_V(x) << ", " << LOG_V(y);
-                    V[x] = V[y];
-                    if (debug) std::cout << LOG_CHANGED << LOG_V(x);
-                    break;
-                case 0x1:  // OR Vx, Vy
-                    if (debug) std::cout << "OR " << LOG_V(x) << ", " << LOG_V(y);
-                    V[x] |= V[y];
-                    if (debug) std::cout << LOG_CHANGED << LOG_V(x);
-                    break;
-                case 0x2:  // AND Vx, Vy
-                    if (debug) std::cout << "AND " << LOG_V(x) << ", " << LOG_V(y);
-                    V[x] &= V[y];
-                    if (debug) std::cout << LOG_CHANGED << LOG_V(x);
-                    break;
-                case 0x3:  // XOR Vx, Vy
-                    if (debug) std::cout << "XOR " << LOG_V(x) << ", " << LOG_V(y);
-                    V[x] ^= V[y];
-                    if (debug) std::cout << LOG_CHANGED << LOG_V(x);
-                    break;
-                case 0x4:  // ADD Vx, Vy
-                    if (debug) std::cout << "ADD " << LOG_V(x) << ", " << LOG_V(y);
-                    V[x] = V[x] + V[y];
-                    V[0xF] = V[y] > V[x] ? 1 : 0;
-                    if (debug) std::cout << LOG_CHANGED << LOG_V(x) << ", " << LOG_V(0xF);
-                    break;
-                case 0x5:  // SUB Vx, Vy
-                    if (debug) std::cout << "SUB " << LOG_V(x) << ", " << LOG_V(y);
-                    V[0xF] = V[y] > V[x] ? 0 : 1;
-                    V[x] = V[x] - V[y];
-                    if (debug) std::cout << LOG_CHANGED << LOG_V(x) << ", " << LOG_V(0xF);
-                    break;
-                case 0x6:  // SHR Vx, Vy
-                    if (debug) std::cout << "SHR " << LOG_V(x) << ", " << LOG_V(y);
-                    V[x] = V[y] >> 1;
-                    V[0xF] = V[y] & 0x1u;
-                    if (debug) std::cout << LOG_CHANGED << LOG_V(x) << ", " << LOG_V(0xF);
-
-                    // from cowgod:
-                    // V[0xF] = V[x] & 0x1;
-                    // V[x] >>= 1;
-                    break;
-                case 0x7:  // SUBN Vx, Vy
-                    if (debug) std::cout << "SUBN " << LOG_V(x) << ", " << LOG_V(y);
-                    V[0xF] = V[y] < V[x] ? 0 : 1;
-                    V[x] = V[y] - V[x];
-                    if (debug) std::cout << LOG_CHANGED << LOG_V(x) << ", " << LOG_V(0xF);
-                    break;
-                case 0xE:  // SHL Vx, Vy
-                    if (debug) std::cout << "SHL " << LOG_V(x) << ", " << LOG_V(y);
-                    V[x] = V[y] << 1;
-                    V[0xF] = V[y] >> 0x7 & 0x1;
-                    if (debug) std::cout << LOG_CHANGED << LOG_V(x) << ", " << LOG_V(0xF);
-
-                    // from cowgod:
-                    // V[0xF] = (V[x] >> 7) & 0x1;
-                    // V[x] <<= 1;
-                    break;
+            switch (inst.n) {
+                case 0x0: inst.op = kLdReg; break;
+                case 0x1: inst.op = kOr; break;
+                case 0x2: inst.op = kAnd; break;
+                case 0x3: inst.op = kXor; break;
+                case 0x4: inst.op = kAddReg; break;
+                case 0x5: inst.op = kSub; break;
+                case 0x6: inst.op = kShr; break;
+                case 0x7: inst.op = kSubn; break;
+                case 0xE: inst.op = kShl; break;
             }
-
-            pc += 2;
-            break;
-        case 0x9000:  // SNE Vx, Vy
-            if (debug) std::cout << "SNE " << LOG_V(x) << ", " << LOG_V(y);
-            pc += V[x] != V[y] ? 4 : 2;
-            if (debug) std::cout << LOG_CHANGED << LOG_V(x);
-            break;
-        case 0xA000:  // LD I, nnn
-            if (debug) std::cout << "LD " << LOG_I << ", " << "0x" << nnn;
-            I = nnn;
-            pc += 2;
-            if (debug) std::cout << LOG_CHANGED << LOG_I;
-            break;
-        case 0xB000:  // JP V0, nnn
-            if (debug) std::cout << "JP " << LOG_V(0) << ", " << "0x" << nnn;
-            pc = nnn + V[0x0];
             break;
-        case 0xC000:  // RND Vx, kk
-            if (debug) std::cout << "RND " << LOG_V(x) << ", " << "0x" << int(kk);
-            V[x] = (uint8_t) rand() & kk;
-            pc += 2;
-            if (debug) std::cout << LOG_CHANGED << LOG_V(x);
-            break;
-        case 0xD000:  // DRW Vx, Vy, n
-            if (debug) std::cout << "DRW " << LOG_V(x) << ", " << LOG_V(y) << ", " << int(n);
-            DrawSprite(V[x], V[y], n);
-            update_display = true;
-            pc += 2;
-            break;
-        case 0xE000:  // Input
-            switch (low) {
-                case 0x9E:  // SKP Vx
-                    if (debug) std::cout << "SKP " << LOG_V(x);
-                    pc += GetKey(V[x]) ? 4 : 2;
-                    break;
-                case 0xA1:  // SKNP Vx
-                    if (debug) std::cout << "SKNP " << LOG_V(x);
-                    pc += !GetKey(V[x]) ? 4 : 2;
-                    break;
-                default:
-                    pc += 2;
-            }
+        case 0x9000: inst.op = kSneReg; break;
+        case 0xA000: inst.op = kLdI; break;
+        case 0xB000: inst.op = kJpV0; break;
+        case 0xC000: inst.op = kRnd; break;
+        case 0xD000: inst.op = kDrw; break;
+        case 0xE000:
+            if (inst.kk == 0x9E) inst.op = kSkp;
+            else if (inst.kk == 0xA1) inst.op = kSknp;
             break;
         case 0xF000:
-            switch (low) {
-                case 0x07:  // LD Vx, DT
-                    if (debug) std::cout << "LD " << LOG_V(x) << ", " << LOG_DT;
-                    V[x] = dt;
-                    pc += 2;
-                    if (debug) std::cout << LOG_CHANGED << LOG_V(x);
-                    break;
-                case 0x0A:  // LD Vx, K
-                    if (debug) std::cout << "LD " << LOG_V(x) << ", K";
-                    // do not increase program counter until a key is pressed
-                    if (keys) {
-                        int key;
-                        for (key = 0; key < 0xF; key++) {
-                            if (GetKey(key)) break;
-                        }
-
-                        V[x] = key;
-                        pc += 2;
-                        if (debug) std::cout << " (" << key << ")" << LOG_CHANGED << LOG_V(x);
-                    }
-                    break;
-                case 0x15:  // LD DT, Vx
-                    if (debug) std::cout << "LD " << LOG_DT << ", " << LOG_V(x);
-                    dt = V[x];
-                    pc += 2;
-                    if (debug) std::cout << LOG_CHANGED << LOG_DT;
-                    break;
-                case 0x18:  // LD ST, Vx
-                    if (debug) std::cout << "LD " << LOG_ST << ", " << LOG_V(x);
-                    st = V[x];
-                    pc += 2;
-                    if (debug) std::cout << LOG_CHANGED << LOG_ST;
-                    break;
-                case 0x1E:  // ADD I, Vx
-                    if (debug) std::cout << "ADD " << LOG_I << ", " << LOG_V(x);
-                    V[0xF] = V[x] + I > 0xFFF ? 1 : 0;
-                    pc += 2;
-                    I += V[x];
-                    if (debug) std::cout << LOG_CHANGED << LOG_I << ", " << LOG_V(0xF);
-                    break;
-                case 0x29:  // LD F, Vx
-                    if (debug) std::cout << "LD F, " << LOG_V(x);
-                    I = V[x] * 0x5;
-                    pc += 2;
-                    if (debug) std::cout << LOG_CHANGED << LOG_I;
-                    break;
-                case 0x33:  // LD B, Vx
-                    if (debug) std::cout << "LD B, " << LOG_V(x);
-                    memory[I] = V[x] / 100;      // hundredth digit
-                    memory[I + 1] = (V[x] / 10) % 10;    // tenth digit
-                    memory[I + 2] = V[x] % 10;          // ones digit
-                    if (debug) std::cout << LOG_CHANGED << "MEMORY[" << LOG_I << "] (" << int(memory[I]) << ", " << int(memory[I + 1]) << ", " << int(memory[I + 2]) << ")";
-                    pc += 2;
-                    break;
-                case 0x55:  // LD [I], Vx
-                    if (debug) std::cout << "LD [I], V" << int(x) << LOG_CHANGED << "MEMORY[" << LOG_I << "] (";
-                    for (int i = 0; i <= x; i++) {
-                        memory[I + i] = V[i];
-                        if (debug) std::cout << "0x" << int(memory[I + i]) << ", ";
-                    }
-                    I += x + 1;
-                    pc += 2;
-                    if (debug) std::cout << "), " << LOG_I;
-                    break;
-                case 0x65:  // LD Vx, [I]
-                    if (debug) std::cout << "LD V" << int(x) << ", [I]" << LOG_CHANGED << "V..." << int(x) << " (";
-                    for (int i = 0; i <= x; i++) {
-                        V[i] = memory[I + i];
-                        if (debug) std::cout << "0x" << int(V[i]) << ", ";
-                    }
-                    I += x + 1;
-                    pc += 2;
-                    if (debug) std::cout << "), " << LOG_I;
-                    break;
-                default:
-                    pc += 2;
+            switch (inst.kk) {
+                case 0x07: inst.op = kLdVxDt; break;
+                case 0x0A: inst.op = kLdVxK; break;
+                case 0x15: inst.op = kLdDtVx; break;
+                case 0x18: inst.op = kLdStVx; break;
+                case 0x1E: inst.op = kAddI; break;
+                case 0x29: inst.op = kLdF; break;
+                case 0x30: inst.op = kLdHf; break;
+                case 0x33: inst.op = kLdB; break;
+                case 0x55: inst.op = kLdStore; break;
+                case 0x65: inst.op = kLdLoad; break;
+                case 0x75: inst.op = kLdR; break;
+                case 0x85: inst.op = kLdVxR; break;
             }
             break;
+    }
+
+    return inst;
+}
+
+// re-decodes every cached instruction overlapping [address, address + length)
+void Chip8::RefreshDecoded(uint16_t address, uint16_t length) {
+    address &= MEMORY_SIZE - 1;
+    if (address + length > MEMORY_SIZE) {
+        RefreshDecoded(0, address + length - MEMORY_SIZE);
+        length = MEMORY_SIZE - address;
+    }
+
+    int first = address >> 1;
+    int last = (address + length - 1) >> 1;
+
+    for (int i = first; i <= last; i++)
+        decoded[i] = Decode(memory[i * 2] << 8 | memory[i * 2 + 1]);
+
+    for (int block = address / WRITE_BLOCK_SIZE; block <= (address + length - 1) / WRITE_BLOCK_SIZE; block++)
+        written_blocks |= uint64_t(1) << block;
+
+    // jumps whose loop reaches back into what changed are looked at again
+    for (int i = first; i <= std::min(last + IDLE_LOOP_LENGTH, MEMORY_SIZE / 2 - 1); i++)
+        idle_class[i] = kIdleUnknown;
+
+    if (recompiler)
+        recompiler->Invalidate(address, length);
+}
+
+inline const Chip8::Instruction *Chip8::Fetch() {
+    if (pc & 0x1) {
+        unaligned = Decode(memory[pc & 0xFFF] << 8 | memory[(pc + 1) & 0xFFF]);
+        return &unaligned;
+    }
+
+    return &decoded[(pc & 0xFFF) >> 1];
+}
+
+void Chip8::Cycle() {
+    RunCycles(1);
+}
+
+uint32_t Chip8::RunCycles(uint32_t cycles) {
+    update_display = false;
+    keys = input_keys.load(std::memory_order_relaxed);
+
+    // delay timer and sound timer
+    if (timer_mode == TimerMode::kRealTime) {
+        auto now = Clock::now();
+        long duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - prev_timer_start).count();
+
+        if (duration > (1000 / TIMER_FREQUENCY)) {
+            TickTimers();
+            prev_timer_start = now;
+        }
+
+        return Execute(cycles);
+    }
+
+    // every instruction moves virtual time on by TIMER_FREQUENCY / clock_speed of a
+    // second, kept as an integer phase so the ticks never drift
+    uint32_t executed = 0;
+    while (executed < cycles) {
+        uint32_t chunk = std::min(cycles - executed, CyclesUntilTick());
+        uint32_t ran = Execute(chunk);
+        executed += ran;
+
+        timer_phase += ran * TIMER_FREQUENCY;
+        if (timer_phase >= clock_speed) {
+            timer_phase -= clock_speed;
+            TickTimers();
+        }
+        if (ran < chunk) break;  // stopped by the debugger
+    }
+
+    return executed;
+}
+
+uint32_t Chip8::RunFrame() {
+    if (timer_mode == TimerMode::kRealTime)
+        return RunCycles(clock_speed / TIMER_FREQUENCY);
+
+    return RunCycles(CyclesUntilTick());
+}
+
+uint32_t Chip8::CyclesUntilTick() const {
+    return (clock_speed - timer_phase + TIMER_FREQUENCY - 1) / TIMER_FREQUENCY;
+}
+
+void Chip8::SetSeed(uint64_t seed) {
+    // xorshift never leaves 0, so that one seed is taken to mean the default
+    rng = seed ? seed : DEFAULT_RNG_SEED;
+}
+
+uint8_t Chip8::Random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng >> 56;  // the top bits are the best mixed
+}
+
+void Chip8::SetQuirks(QuirkPreset preset) {
+    quirks = preset;
+    SelectExecutor();
+}
+
+QuirkPreset Chip8::GetQuirks() const {
+    return quirks;
+}
+
+void Chip8::SetTimerMode(TimerMode mode) {
+    timer_mode = mode;
+    timer_phase = 0;
+    prev_timer_start = Clock::now();
+}
+
+void Chip8::SetClockSpeed(uint32_t instructions_per_second) {
+    clock_speed = std::max<uint32_t>(instructions_per_second, TIMER_FREQUENCY);
+    timer_phase = 0;
+}
+
+uint32_t Chip8::GetClockSpeed() const {
+    return clock_speed;
+}
+
+uint32_t Chip8::Execute(uint32_t cycles) {
+    // the interpreter stops early when the display mode changes, the rest of the
+    // batch then runs in the instantiation for the new mode
+    uint32_t executed = 0;
+    while (executed < cycles) {
+        executed += (this->*executor)(cycles - executed);
+        if (debugger && debugger->Stopped()) break;
+    }
+
+    return executed;
+}
+
+uint32_t Chip8::Recompile(uint32_t cycles) {
+    return recompiler->Execute(cycles);
+}
+
+uint32_t Chip8::Fallback(uint32_t cycles) {
+    return (this->*interpreter)(cycles);
+}
+
+void Chip8::SelectExecutor() {
+    switch (quirks) {
+        case QuirkPreset::kChip48:
+            SelectExecutorFor<Chip48Quirks>();
+            break;
+        case QuirkPreset::kSuperChip:
+            SelectExecutorFor<SuperChipQuirks>();
+            break;
         default:
+            SelectExecutorFor<CosmacVipQuirks>();
+    }
+}
+
+template <class Quirks>
+void Chip8::SelectExecutorFor() {
+    if (hires)
+        SelectExecutorFor<HiRes, Quirks>();
+    else
+        SelectExecutorFor<LoRes, Quirks>();
+}
+
+// debuggers, tracing, stats and latency probes need every instruction to go through the interpreter.
+// The recompiler hands everything quirky to Fallback(), so it serves every preset as is
+template <class Geometry, class Quirks>
+void Chip8::SelectExecutorFor() {
+    interpreter = &Chip8::Interpret<kHookNone, Geometry, Quirks>;
+
+    if (debugger)
+        executor = &Chip8::Interpret<kHookDebug, Geometry, Quirks>;
+    else if (tracer)
+        executor = &Chip8::Interpret<kHookTrace, Geometry, Quirks>;
+    else if (stats_enabled)
+        executor = &Chip8::Interpret<kHookStats, Geometry, Quirks>;
+    else if (latency_probe)
+        executor = &Chip8::Interpret<kHookLatency, Geometry, Quirks>;
+    else if (profiler)
+        executor = &Chip8::Interpret<kHookProfile, Geometry, Quirks>;
+    else if (recompiler)
+        executor = &Chip8::Recompile;
+    else
+        executor = interpreter;
+}
+
+bool Chip8::StartTrace(const std::string &path) {
+    tracer.reset(new Tracer());
+    if (!tracer->Open(path)) {
+        tracer.reset();
+        return false;
+    }
+
+    // the first record holds the registers the first traced instruction starts from
+    TraceRecord snapshot = TraceState(pc, 0, dt, st);
+    snapshot.flags = TRACE_SNAPSHOT;
+    tracer->Push(snapshot);
+
+    SelectExecutor();
+    return true;
+}
+
+void Chip8::StopTrace() {
+    tracer.reset();
+    SelectExecutor();
+}
+
+void Chip8::EnableStats(bool enabled) {
+    stats_enabled = enabled;
+    SelectExecutor();
+}
+
+void Chip8::AttachLatencyProbe(LatencyProbe *probe) {
+    latency_probe = probe;
+    SelectExecutor();
+}
+
+void Chip8::AttachDebugger(Debugger *attached) {
+    debugger = attached;
+    SelectExecutor();
+}
+
+void Chip8::EnableProfiler(bool enabled) {
+    static_assert(kLdVxR + 1 == PROFILE_OPS, "Profile.cpp names every instruction kind");
+
+    if (enabled && !profiler)
+        profiler.reset(new Profiler());
+    else if (!enabled)
+        profiler.reset();
+    SelectExecutor();
+}
+
+Profiler *Chip8::GetProfiler() const {
+    return profiler.get();
+}
+
+const ExecStats &Chip8::GetStats() const {
+    return stats;
+}
+
+void Chip8::ResetStats() {
+    stats = {};
+}
+
+TraceRecord Chip8::TraceState(uint16_t address, uint16_t instruction, uint8_t timer, uint8_t sound) const {
+    TraceRecord record = {};
+    record.pc = address;
+    record.opcode = instruction;
+    record.I = I;
+    record.keys = keys;
+    record.sp = sp;
+    record.dt = timer;
+    record.st = sound;
+    memcpy(record.V, V, sizeof(V));
+    return record;
+}
+
+void Chip8::TickTimers() {
+    if (dt > 0) dt--;
+    if (st > 0) st--;
+}
+
+// a candidate when the loop from `target` up to the jump only reads memory and writes
+// registers, so the next turn can only differ from the last through dt or the keys
+Chip8::IdleClass Chip8::ClassifyLoop(uint16_t jump, uint16_t target) const {
+    if (jump & 0x1 || target & 0x1 || target > jump || (jump - target) / 2 >= IDLE_LOOP_LENGTH) return kIdleNever;
+
+    for (uint16_t address = target; address < jump; address += 2) {
+        switch (decoded[address >> 1].op) {
+            case kNop: case kSeImm: case kSneImm: case kSeReg: case kSneReg: case kLdImm:
+            case kAddImm: case kLdReg: case kOr: case kAnd: case kXor: case kAddReg: case kSub:
+            case kShr: case kSubn: case kShl: case kLdI: case kSkp: case kSknp: case kLdVxDt:
+            case kAddI: case kLdF: case kLdHf: case kLdLoad: case kLdVxR:
+                break;
+            default:
+                return kIdleNever;
+        }
+    }
+
+    return kIdleCandidate;
+}
+
+uint32_t Chip8::IdleSkip(uint16_t target, uint32_t executed, uint32_t remaining) {
+    uint16_t jump = pc & (MEMORY_SIZE - 1);
+    IdleClass &loop = idle_class[jump >> 1];
+    if (loop == kIdleUnknown) loop = ClassifyLoop(jump, target);
+    if (loop == kIdleNever) return 0;
+
+    bool same = idle_visit.jump == jump && idle_visit.I == I && idle_visit.keys == keys && idle_visit.dt == dt
+        && memcmp(idle_visit.V, V, sizeof(V)) == 0;
+    uint32_t period = executed - idle_visit.executed;
+
+    // a loop only goes round its own instructions, anything longer went elsewhere in between
+    uint32_t length = uint32_t(jump - target) / 2 + 1;
+    uint32_t skip = same && period <= length ? remaining / period * period : 0;
+
+    idle_visit.jump = jump;
+    idle_visit.I = I;
+    idle_visit.keys = keys;
+    idle_visit.dt = dt;
+    memcpy(idle_visit.V, V, sizeof(V));
+    idle_visit.executed = executed + skip;
+    return skip;
+}
+
+// GCC and Clang dispatch through a table of label addresses, with the fetch
+// repeated at the end of every handler. Other compilers get a plain switch.
+#if defined(__GNUC__)
+#define CHIP8LER_COMPUTED_GOTO 1
+#else
+#define CHIP8LER_COMPUTED_GOTO 0
+#endif
+
+template <Chip8::Hook kHook, class Geometry, class Quirks>
+uint32_t Chip8::Interpret(uint32_t cycles) {
+    const Instruction *inst;
+    uint32_t executed = 0;
+    idle_visit.jump = NO_IDLE_JUMP;  // dt and keys may have changed since the last batch
+    [[maybe_unused]] uint16_t trace_pc = 0;
+    [[maybe_unused]] uint16_t trace_opcode = 0;
+    [[maybe_unused]] uint8_t trace_dt = 0;
+    [[maybe_unused]] uint8_t trace_st = 0;
+
+#if CHIP8LER_COMPUTED_GOTO
+    static const void *const dispatch[] = {
+        &&L_kNop, &&L_kCls, &&L_kRet, &&L_kJp, &&L_kCall, &&L_kSeImm, &&L_kSneImm, &&L_kSeReg, &&L_kLdImm,
+        &&L_kAddImm, &&L_kLdReg, &&L_kOr, &&L_kAnd, &&L_kXor, &&L_kAddReg, &&L_kSub, &&L_kShr, &&L_kSubn,
+        &&L_kShl, &&L_kSneReg, &&L_kLdI, &&L_kJpV0, &&L_kRnd, &&L_kDrw, &&L_kSkp, &&L_kSknp, &&L_kLdVxDt,
+        &&L_kLdVxK, &&L_kLdDtVx, &&L_kLdStVx, &&L_kAddI, &&L_kLdF, &&L_kLdB, &&L_kLdStore, &&L_kLdLoad,
+        &&L_kScd, &&L_kScr, &&L_kScl, &&L_kExit, &&L_kLow, &&L_kHigh, &&L_kLdHf, &&L_kLdR, &&L_kLdVxR,
+    };
+
+#define HANDLER(op) L_##op
+#define NEXT() do {                                 \
+        END_INSTRUCTION();                          \
+        if (executed == cycles) return executed;    \
+        inst = Fetch();                             \
+        STOP_BEFORE();                              \
+        executed++;                                 \
+        BEGIN_INSTRUCTION();                        \
+        goto *dispatch[inst->op];                   \
+    } while (0)
+#else
+#define HANDLER(op) case op
+#define NEXT() continue
+#endif
+
+// the trace record for an instruction is taken once it has finished
+#define BEGIN_INSTRUCTION() do {                                    \
+        opcode = inst->opcode;                                      \
+        if constexpr (kHook == kHookStats) stats.instructions++;    \
+        if constexpr (kHook == kHookProfile) profiler->Count(inst->op, pc); \
+        if constexpr (kHook == kHookTrace) {                        \
+            trace_pc = pc;                                          \
+            trace_opcode = opcode;                                  \
+            trace_dt = dt;                                          \
+            trace_st = st;                                          \
+        }                                                           \
+    } while (0)
+// the debugger sees the instruction before any of it has run
+#define STOP_BEFORE() do {                                          \
+        if constexpr (kHook == kHookDebug) {                        \
+            if (debugger->Stops(*this, inst->opcode)) return executed; \
+        }                                                           \
+    } while (0)
+#define END_INSTRUCTION() do {                                      \
+        if constexpr (kHook == kHookTrace) {                        \
+            if (executed) tracer->Push(TraceState(trace_pc, trace_opcode, trace_dt, trace_st)); \
+        }                                                           \
+    } while (0)
+
+#if CHIP8LER_COMPUTED_GOTO
+    NEXT();
+#else
+    for (;;) {
+        END_INSTRUCTION();
+        if (executed == cycles) return executed;
+        inst = Fetch();
+        STOP_BEFORE();
+        executed++;
+        BEGIN_INSTRUCTION();
+
+        switch (inst->op) {
+#endif
+
+    HANDLER(kNop):
+        pc += 2;
+        NEXT();
+    HANDLER(kCls):  // CLS - Clear screen
+        ClearDisplay();
+        pc += 2;
+        NEXT();
+    HANDLER(kRet):  // RET - Return from call
+        if constexpr (kHook == kHookProfile) profiler->Return();
+        pc = stack[--sp] + 2;
+        NEXT();
+    HANDLER(kJp):  // JP nnn
+        if constexpr (kHook == kHookNone) {
+            if ((inst->opcode & 0x0FFF) <= pc)
+                executed += IdleSkip(inst->opcode & 0x0FFF, executed, cycles - executed);
+        }
+        pc = inst->opcode & 0x0FFF;
+        NEXT();
+    HANDLER(kCall):  // CALL nnn
+        if constexpr (kHook == kHookProfile) profiler->Call(inst->opcode & 0x0FFF);
+        stack[sp++] = pc;
+        pc = inst->opcode & 0x0FFF;
+        NEXT();
+    HANDLER(kSeImm):  // SE Vx, kk
+        pc += V[inst->x] == inst->kk ? 4 : 2;
+        NEXT();
+    HANDLER(kSneImm):  // SNE Vx, kk
+        pc += V[inst->x] != inst->kk ? 4 : 2;
+        NEXT();
+    HANDLER(kSeReg):  // SE Vx, Vy
+        pc += V[inst->x] == V[inst->y] ? 4 : 2;
+        NEXT();
+    HANDLER(kLdImm):  // LD Vx, kk
+        V[inst->x] = inst->kk;
+        pc += 2;
+        NEXT();
+    HANDLER(kAddImm):  // ADD Vx, kk
+        V[inst->x] += inst->kk;
+        pc += 2;
+        NEXT();
+    HANDLER(kLdReg):  // LD Vx, Vy
+        V[inst->x] = V[inst->y];
+        pc += 2;
+        NEXT();
+    HANDLER(kOr):  // OR Vx, Vy
+        V[inst->x] |= V[inst->y];
+        pc += 2;
+        NEXT();
+    HANDLER(kAnd):  // AND Vx, Vy
+        V[inst->x] &= V[inst->y];
+        pc += 2;
+        NEXT();
+    HANDLER(kXor):  // XOR Vx, Vy
+        V[inst->x] ^= V[inst->y];
+        pc += 2;
+        NEXT();
+    HANDLER(kAddReg):  // ADD Vx, Vy
+        V[inst->x] = V[inst->x] + V[inst->y];
+        V[0xF] = V[inst->y] > V[inst->x] ? 1 : 0;
+        pc += 2;
+        NEXT();
+    HANDLER(kSub):  // SUB Vx, Vy
+        V[0xF] = V[inst->y] > V[inst->x] ? 0 : 1;
+        V[inst->x] = V[inst->x] - V[inst->y];
+        pc += 2;
+        NEXT();
+    HANDLER(kShr): {  // SHR Vx, Vy - CHIP-48 shifts Vx in place
+        uint8_t source = Quirks::kShiftVy ? V[inst->y] : V[inst->x];
+        V[inst->x] = source >> 1;
+        V[0xF] = source & 0x1u;
+        pc += 2;
+        NEXT();
+    }
+    HANDLER(kSubn):  // SUBN Vx, Vy
+        V[0xF] = V[inst->y] < V[inst->x] ? 0 : 1;
+        V[inst->x] = V[inst->y] - V[inst->x];
+        pc += 2;
+        NEXT();
+    HANDLER(kShl): {  // SHL Vx, Vy - CHIP-48 shifts Vx in place
+        uint8_t source = Quirks::kShiftVy ? V[inst->y] : V[inst->x];
+        V[inst->x] = source << 1;
+        V[0xF] = source >> 0x7 & 0x1;
+        pc += 2;
+        NEXT();
+    }
+    HANDLER(kSneReg):  // SNE Vx, Vy
+        pc += V[inst->x] != V[inst->y] ? 4 : 2;
+        NEXT();
+    HANDLER(kLdI):  // LD I, nnn
+        I = inst->opcode & 0x0FFF;
+        pc += 2;
+        NEXT();
+    HANDLER(kJpV0):  // JP V0, nnn - CHIP-48 reads it as JP Vx, xnn
+        pc = (inst->opcode & 0x0FFF) + V[Quirks::kJumpVx ? inst->x : 0x0];
+        NEXT();
+    HANDLER(kRnd):  // RND Vx, kk
+        V[inst->x] = Random() & inst->kk;
+        pc += 2;
+        NEXT();
+    HANDLER(kDrw): {  // DRW Vx, Vy, n
+        [[maybe_unused]] uint8_t draw_y = V[inst->y];  // before VF takes the collision flag
+        if constexpr (kHook == kHookStats) {
+            auto start = Clock::now();
+            DrawSprite<Geometry, Quirks::kWrapSprites>(V[inst->x], V[inst->y], inst->n);
+            stats.draw_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            stats.draws++;
+        } else {
+            DrawSprite<Geometry, Quirks::kWrapSprites>(V[inst->x], V[inst->y], inst->n);
+        }
+        if constexpr (kHook == kHookLatency) latency_probe->Drawn();
+        if constexpr (kHook == kHookProfile) {
+            // rows past the bottom edge are clipped
+            int rows = inst->n ? inst->n : 16;
+            if constexpr (!Quirks::kWrapSprites)
+                rows = std::min(rows, Geometry::kHeight - draw_y % Geometry::kHeight);
+            profiler->Drawn(rows);
+        }
+        update_display = true;
+        pc += 2;
+        NEXT();
+    }
+    HANDLER(kSkp):  // SKP Vx
+        if constexpr (kHook == kHookLatency) latency_probe->Observed(V[inst->x]);
+        pc += GetKey(V[inst->x]) ? 4 : 2;
+        NEXT();
+    HANDLER(kSknp):  // SKNP Vx
+        if constexpr (kHook == kHookLatency) latency_probe->Observed(V[inst->x]);
+        pc += !GetKey(V[inst->x]) ? 4 : 2;
+        NEXT();
+    HANDLER(kLdVxDt):  // LD Vx, DT
+        V[inst->x] = dt;
+        pc += 2;
+        NEXT();
+    HANDLER(kLdVxK):  // LD Vx, K
+        // do not increase program counter until a key is pressed
+        if (keys) {
+            int key;
+            for (key = 0; key < 0xF; key++) {
+                if (GetKey(key)) break;
+            }
+
+            V[inst->x] = key;
             pc += 2;
+            if constexpr (kHook == kHookLatency) latency_probe->Observed(key);
+        } else if constexpr (kHook == kHookNone) {
+            // keys only change between batches, so neither does anything else until then
+            executed = cycles;
+        }
+        NEXT();
+    HANDLER(kLdDtVx):  // LD DT, Vx
+        dt = V[inst->x];
+        pc += 2;
+        NEXT();
+    HANDLER(kLdStVx):  // LD ST, Vx
+        st = V[inst->x];
+        pc += 2;
+        NEXT();
+    HANDLER(kAddI):  // ADD I, Vx
+        V[0xF] = V[inst->x] + I > 0xFFF ? 1 : 0;
+        pc += 2;
+        I += V[inst->x];
+        NEXT();
+    HANDLER(kLdF):  // LD F, Vx
+        I = V[inst->x] * 0x5;
+        pc += 2;
+        NEXT();
+    HANDLER(kLdB):  // LD B, Vx
+        MEM(I) = V[inst->x] / 100;      // hundredth digit
+        MEM(I + 1) = (V[inst->x] / 10) % 10;    // tenth digit
+        MEM(I + 2) = V[inst->x] % 10;          // ones digit
+        RefreshDecoded(I, 3);
+        pc += 2;
+        NEXT();
+    HANDLER(kLdStore):  // LD [I], Vx
+        for (int i = 0; i <= inst->x; i++) {
+            MEM(I + i) = V[i];
+        }
+        RefreshDecoded(I, inst->x + 1);
+        if constexpr (Quirks::kIndex == IndexQuirk::kIncrement) I += inst->x + 1;
+        if constexpr (Quirks::kIndex == IndexQuirk::kIncrementByX) I += inst->x;
+        pc += 2;
+        NEXT();
+    HANDLER(kLdLoad):  // LD Vx, [I]
+        for (int i = 0; i <= inst->x; i++) {
+            V[i] = MEM(I + i);
+        }
+        if constexpr (Quirks::kIndex == IndexQuirk::kIncrement) I += inst->x + 1;
+        if constexpr (Quirks::kIndex == IndexQuirk::kIncrementByX) I += inst->x;
+        pc += 2;
+        NEXT();
+    HANDLER(kScd):  // SCD n - scroll down n rows
+        Scroll<Geometry>(inst->n, 0);
+        pc += 2;
+        NEXT();
+    HANDLER(kScr):  // SCR - scroll right 4 pixels
+        Scroll<Geometry>(0, 4);
+        pc += 2;
+        NEXT();
+    HANDLER(kScl):  // SCL - scroll left 4 pixels
+        Scroll<Geometry>(0, -4);
+        pc += 2;
+        NEXT();
+    HANDLER(kExit):  // EXIT - there is nothing to return to, so stay on this instruction
+        if constexpr (kHook == kHookNone) executed = cycles;
+        NEXT();
+    HANDLER(kLow):  // LOW - 64x32 screen
+    HANDLER(kHigh):  // HIGH - 128x64 screen
+        hires = inst->op == kHigh;
+        ClearDisplay();
+        pc += 2;
+        if (hires != (Geometry::kWords == 2)) {
+            // this instantiation draws the wrong size now, let Execute() carry on in the other one
+            SelectExecutor();
+            END_INSTRUCTION();
+            return executed;
+        }
+        NEXT();
+    HANDLER(kLdHf):  // LD HF, Vx
+        I = BIG_FONT_ADDRESS + (V[inst->x] & 0xF) * 10;
+        pc += 2;
+        NEXT();
+    HANDLER(kLdR):  // LD R, Vx
+        for (int i = 0; i <= std::min<int>(inst->x, RPL_FLAGS - 1); i++) {
+            rpl[i] = V[i];
+        }
+        pc += 2;
+        NEXT();
+    HANDLER(kLdVxR):  // LD Vx, R
+        for (int i = 0; i <= std::min<int>(inst->x, RPL_FLAGS - 1); i++) {
+            V[i] = rpl[i];
+        }
+        pc += 2;
+        NEXT();
+
+#if !CHIP8LER_COMPUTED_GOTO
+        }
     }
+#endif
 
-    if (debug) std::cout << std::endl;
+#undef HANDLER
+#undef NEXT
+#undef BEGIN_INSTRUCTION
+#undef STOP_BEFORE
+#undef END_INSTRUCTION
 }
 
+// SuperCHIP draws 16 rows for n = 0, 16 pixels wide on the extended screen
+template <class Geometry, bool kWrap>
 void Chip8::DrawSprite(int posx, int posy, int height) {
-    uint8_t x, y, point;
+    int width = 8;
+    if (height == 0) {
+        height = 16;
+        if constexpr (Geometry::kWords == 2) width = 16;
+    }
 
-    // sprites drawn outside the frame should be wrapped back into it
-    // NOTE: sprites drawn partially inside the frame should be clipped, not wrapped
-    posx = posx % DISPLAY_WIDTH;
-    posy = posy % DISPLAY_HEIGHT;
-    V[0xF] = 0;
+    // sprites drawn outside the frame are wrapped back into it, what then runs off an
+    // edge is clipped unless kWrap
+    posx = posx % Geometry::kWidth;
+    posy = posy % Geometry::kHeight;
+    int collisions = 0;
 
     for (int j = 0; j < height; j++) {
-        y = posy + j;
-        if (y >= DISPLAY_HEIGHT) continue;
-
-        for (int i = 0; i < 8; i++) {
-            x = posx + i;
-            if (x >= DISPLAY_WIDTH) break;
-
-            point = memory[I + j] >> (7 - i) & 0x1;
-            if (debug) std::cout << LOG_CHANGED << "x: 0x" << int(x) << ", y: 0x" << int(y) << " point: 0x" << int(point)
-                                 << " disp: 0x" << int(display[y][x]);
-            display[y][x] ^= point;
-            if (debug) std::cout << " → 0x" << int(display[y][x]);
-
-            // catch bits that are changed by a set bit
-            if (point && !display[y][x])
-                V[0xF] = 1;
+        int y = posy + j;
+        if constexpr (kWrap) y %= Geometry::kHeight;
+        else if (y >= Geometry::kHeight) break;
+
+        // leftmost pixel is the top bit, anything shifted past the right edge is clipped
+        uint64_t bits = width == 16 ? uint64_t(MEM(I + j * 2)) << 56 | uint64_t(MEM(I + j * 2 + 1)) << 48
+                                    : uint64_t(MEM(I + j)) << 56;
+        uint64_t *row = display[y];
+        uint64_t collision;
+
+        if constexpr (Geometry::kWords == 1) {
+            uint64_t sprite = bits >> posx;
+            if constexpr (kWrap) sprite |= posx ? bits << (64 - posx) : 0;
+            collision = row[0] & sprite;
+            row[0] ^= sprite;
+        } else {
+            // split over the two words of the row
+            uint64_t left = posx < 64 ? bits >> posx : 0;
+            uint64_t right = posx < 64 ? (posx ? bits << (64 - posx) : 0) : bits >> (posx - 64);
+            if constexpr (kWrap) left |= posx > 64 ? bits << (128 - posx) : 0;
+            collision = (row[0] & left) | (row[1] & right);
+            row[0] ^= left;
+            row[1] ^= right;
         }
+
+        if (collision) collisions++;
     }
 
-    if (debug) std::cout << LOG_CHANGED << LOG_V(0xF);
+    // the extended screen counts the rows that collided, otherwise VF is just a flag
+    if constexpr (Geometry::kWords == 2)
+        V[0xF] = collisions;
+    else
+        V[0xF] = collisions ? 1 : 0;
+}
+
+// Chip8Batch draws on its lanes directly
+template void Chip8::DrawSprite<LoRes, false>(int posx, int posy, int height);
+template void Chip8::DrawSprite<HiRes, false>(int posx, int posy, int height);
+
+// moves the whole screen `down` rows and `right` pixels (left when negative), what is
+// scrolled in is blank
+template <class Geometry>
+void Chip8::Scroll(int down, int right) {
+    for (int y = Geometry::kHeight - 1; down && y >= 0; y--) {
+        for (int w = 0; w < Geometry::kWords; w++)
+            display[y][w] = y >= down ? display[y - down][w] : 0;
+    }
+
+    for (int y = 0; right && y < Geometry::kHeight; y++) {
+        uint64_t *row = display[y];
+        if constexpr (Geometry::kWords == 1) {
+            row[0] = right > 0 ? row[0] >> right : row[0] << -right;
+        } else if (right > 0) {
+            row[1] = row[1] >> right | row[0] << (64 - right);
+            row[0] >>= right;
+        } else {
+            row[0] = row[0] << -right | row[1] >> (64 + right);
+            row[1] <<= -right;
+        }
+    }
+
+    update_display = true;
+}
+
+void Chip8::ClearDisplay() {
+    memset(display, 0, sizeof(display));
+    update_display = true;
+}
+
+bool Chip8::EnableRecompiler() {
+    if (!Recompiler::IsSupported())
+        return false;
+
+    recompiler.reset(new Recompiler(this));
+    SelectExecutor();
+    return true;
+}
+
+const Chip8State &Chip8::GetState() const {
+    return *this;
+}
+
+void Chip8::SetState(const Chip8State &state) {
+    // only pages whose bytes changed need decoding again, which keeps rewinding cheap
+    uint32_t changed_pages = 0;
+    for (int page = 0; page < MEMORY_SIZE / STATE_PAGE_SIZE; page++) {
+        int offset = page * STATE_PAGE_SIZE;
+        if (memcmp(memory + offset, state.memory + offset, STATE_PAGE_SIZE) != 0)
+            changed_pages |= 1u << page;
+    }
+
+    static_cast<Chip8State &>(*this) = state;
+
+    for (int page = 0; page < MEMORY_SIZE / STATE_PAGE_SIZE; page++) {
+        if (changed_pages & 1u << page)
+            RefreshDecoded(page * STATE_PAGE_SIZE, STATE_PAGE_SIZE);
+    }
+
+    update_display = true;
+    SelectExecutor();
+}
+
+bool Chip8::SaveState(const std::string &path) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to save state: " << path << std::endl;
+        return false;
+    }
+
+    StateHeader header = {STATE_MAGIC, STATE_VERSION, 0, sizeof(Chip8State)};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(&GetState()), sizeof(Chip8State));
+    return file.good();
+}
+
+bool Chip8::LoadState(const std::string &path) {
+    MappedFile file;
+    if (!file.Open(path)) {
+        std::cerr << "Failed to load state: " << path << std::endl;
+        return false;
+    }
+
+    StateHeader header;
+    if (file.Size() != sizeof(header) + sizeof(Chip8State)) {
+        std::cerr << "Failed to load state, wrong size: " << path << std::endl;
+        return false;
+    }
+
+    memcpy(&header, file.Data(), sizeof(header));
+    if (header.magic != STATE_MAGIC || header.version != STATE_VERSION || header.state_size != sizeof(Chip8State)) {
+        std::cerr << "Failed to load state, unsupported version: " << path << std::endl;
+        return false;
+    }
+
+    // the mapping is only guaranteed to be byte aligned past the header, so copy it out
+    // rather than pointing a Chip8State at it
+    Chip8State state;
+    memcpy(&state, file.Data() + sizeof(header), sizeof(state));
+
+    // a stack pointer past the stack would have CALL and RET write over the rest of the machine
+    if (state.sp > STACK_SIZE || state.hires > 1 || state.rng == 0) {
+        std::cerr << "Failed to load state, damaged: " << path << std::endl;
+        return false;
+    }
+    SetState(state);
+    return true;
+}
+
+bool Chip8::SameState(const Chip8 &other) const {
+    return memcmp(&GetState(), &other.GetState(), sizeof(Chip8State)) == 0;
 }
 
 bool Chip8::HasNoInstructions() {
-    return pc != 0x200 && opcode == 0x0000;
+    return pc != PROGRAM_START && opcode == 0x0000;
+}
+
+bool Chip8::IsHires() const {
+    return hires;
+}
+
+int Chip8::GetDisplayWidth() const {
+    return hires ? HiRes::kWidth : LoRes::kWidth;
+}
+
+int Chip8::GetDisplayHeight() const {
+    return hires ? HiRes::kHeight : LoRes::kHeight;
+}
+
+uint64_t Chip8::GetDisplayRow(int y, int word) const {
+    return display[y][word];
+}
+
+bool Chip8::GetPixel(int x, int y) const {
+    return display[y][x >> 6] >> (63 - (x & 63)) & 0x1;
+}
+
+void Chip8::GetFrame(Frame &frame) const {
+    memcpy(frame.display, display, sizeof(frame.display));
+    frame.hires = hires;
 }
 
 bool Chip8::ShouldUpdateDisplay() {
@@ -393,12 +1018,19 @@ bool Chip8::ShouldBuzz() {
 }
 
 bool Chip8::GetKey(uint8_t key) {
-    return keys >> key & 0x1u;
+    return keys >> (key & 0xF) & 0x1u;  // only the low nibble names a key, as on the batch and the recompiler
 }
 
 void Chip8::SetKey(uint8_t key, bool pressed) {
+    if (latency_probe)
+        latency_probe->KeySet(key);
+
     if (pressed)
-        keys |= 0x1 << key;
+        input_keys.fetch_or(0x1 << key, std::memory_order_relaxed);
     else
-        keys &= ~(0x1 << key);
+        input_keys.fetch_and(~(0x1 << key), std::memory_order_relaxed);
+}
+
+void Chip8::SetKeys(uint16_t keys) {
+    input_keys.store(keys, std::memory_order_relaxed);
 }
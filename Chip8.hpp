@@ -2,51 +2,319 @@
 #define CHIP8LER__CHIP8_HPP_
 
 #define MEMORY_SIZE 4096
+#define PROGRAM_START 0x200  // programs are loaded and start at 512
+#define MAX_ROM_SIZE (MEMORY_SIZE - PROGRAM_START)  // 3.5 KB
 #define STACK_SIZE 16
 #define DISPLAY_WIDTH 64
 #define DISPLAY_HEIGHT 32
+#define HIRES_DISPLAY_WIDTH 128  // SuperCHIP extended screen
+#define HIRES_DISPLAY_HEIGHT 64
+#define BIG_FONT_ADDRESS 0x50    // SuperCHIP 8x10 digits, right after the 4x5 font
+#define RPL_FLAGS 8              // SuperCHIP user flags saved by Fx75
+#define TIMER_FREQUENCY 60
+#define DEFAULT_CLOCK_SPEED 500  // instructions per second
+#define DEFAULT_RNG_SEED 1234
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <chrono>
+#include <memory>
 
-class Chip8 {
+#include "Quirks.hpp"
+
+class Chip8Batch;
+class Recompiler;
+class Tracer;
+class LatencyProbe;
+class Profiler;
+class Debugger;
+struct TraceRecord;
+
+#define STATE_MAGIC 0x53533843  // "C8SS"
+#define STATE_VERSION 3
+#define STATE_PAGE_SIZE 256  // granularity used to find memory that changed on restore
+#define WRITE_BLOCK_SIZE 64  // granularity of Chip8::written_blocks
+#define IDLE_LOOP_LENGTH 8   // instructions, longest loop checked for only waiting on the delay timer or keys
+
+// Everything that makes up a running machine, kept in one plain block so that saving,
+// restoring and comparing machines is a single memcpy or memcmp. Fields are ordered so
+// there is no hidden padding.
+struct Chip8State {
+    uint8_t memory[MEMORY_SIZE] = {};
+    // two words per row, the leftmost pixel in the top bit of the first. The 64x32 screen
+    // only uses the first word of the first 32 rows
+    uint64_t display[HIRES_DISPLAY_HEIGHT][HIRES_DISPLAY_WIDTH / 64] = {};
+    uint16_t stack[STACK_SIZE] = {};
+
+    uint8_t V[16] = {};  // general purpose registers
+    uint16_t I = 0;     // address register
+    uint16_t pc = 0;    // program counter
+    uint16_t keys = 0;  // each bit represents a key
+    uint16_t opcode = 0;  // last executed instruction
+
+    uint32_t timer_phase = 0;  // virtual time since the last tick, in 1/60 instructions
+    uint8_t sp = 0;     // stack pointer
+    uint8_t dt = 0;     // delay timer
+    uint8_t st = 0;     // sound timer
+    uint8_t hires = 0;  // SuperCHIP extended screen is on
+    uint8_t rpl[RPL_FLAGS] = {};
+    uint64_t rng = DEFAULT_RNG_SEED;  // xorshift64 state behind RND, never 0
+};
+
+static_assert(sizeof(Chip8State) == 5200, "Chip8State must not contain padding");
+
+struct StateHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t state_size;
+};
+
+// a finished picture, copied out of the machine so it can be drawn on another thread
+struct Frame {
+    uint64_t display[HIRES_DISPLAY_HEIGHT][HIRES_DISPLAY_WIDTH / 64];
+    bool hires;
+    uint64_t number;  // counts up with every frame published
+};
+
+// counters gathered while stats are enabled, for benchmarking
+struct ExecStats {
+    uint64_t instructions;
+    uint64_t draws;
+    uint64_t draw_nanoseconds;  // time spent inside DrawSprite
+};
+
+// Screen size as a compile-time parameter, so the interpreter and renderer get one
+// instantiation per mode with fixed loop bounds
+template <int width, int height>
+struct DisplayGeometry {
+    static constexpr int kWidth = width;
+    static constexpr int kHeight = height;
+    static constexpr int kWords = width / 64;  // 64 bit words per row
+};
+
+using LoRes = DisplayGeometry<DISPLAY_WIDTH, DISPLAY_HEIGHT>;
+using HiRes = DisplayGeometry<HIRES_DISPLAY_WIDTH, HIRES_DISPLAY_HEIGHT>;
+
+enum class TimerMode {
+    kRealTime,  // timers follow the host clock
+    kVirtual,   // timers tick every clock speed / 60 instructions
+};
+
+// Private inheritance keeps the interpreter reading plain V, I, pc... while the whole
+// machine can still be copied in and out as one Chip8State
+class Chip8 : private Chip8State {
  public:
-    explicit Chip8(bool debug = false);
+    Chip8();
     ~Chip8();
 
+    // the rom goes at PROGRAM_START, false if it does not fit. The path is mapped rather
+    // than read, the buffer is copied and can be released once this returns. The quirks
+    // are taken from the quirk database, the COSMAC VIP ones for roms not in it
     bool LoadRom(const std::string& path);
+    bool LoadRom(const uint8_t *data, size_t size);
     void Cycle();
     bool HasNoInstructions();
 
-    uint8_t display[DISPLAY_HEIGHT][DISPLAY_WIDTH] = {};
+    // run a batch of instructions, ticking the timers along the way.
+    // RunFrame runs up to and including the next 60 Hz timer tick
+    uint32_t RunCycles(uint32_t cycles);
+    uint32_t RunFrame();
+
+    // RND draws from a generator of each machine's own, the same seed gives the same numbers
+    void SetSeed(uint64_t seed);
+
+    // how the instructions the CHIP-8 variants disagree on behave, see Quirks.hpp. Each
+    // preset runs its own specialisation of the interpreter
+    void SetQuirks(QuirkPreset preset);
+    QuirkPreset GetQuirks() const;
+
+    void SetTimerMode(TimerMode mode);
+    // no slower than TIMER_FREQUENCY, the timers tick at most once per instruction
+    void SetClockSpeed(uint32_t instructions_per_second);
+    uint32_t GetClockSpeed() const;
+
+    // runs up to `cycles` instructions back to back without touching the timers
+    uint32_t Execute(uint32_t cycles);
+    void TickTimers();
+
+    // switches Execute() over to the x86-64 recompiler, false if unsupported here
+    bool EnableRecompiler();
+
+    // records every executed instruction to a binary trace file, see Trace.hpp.
+    // Takes over from the recompiler while active
+    bool StartTrace(const std::string &path);
+    void StopTrace();
+
+    // counts instructions and times every sprite draw. Takes over from the recompiler
+    // while enabled, and is ignored while tracing
+    void EnableStats(bool enabled);
+    const ExecStats &GetStats() const;
+    void ResetStats();
+
+    // reports key checks and draws to `probe`, see Latency.hpp. Takes over from the
+    // recompiler while attached, nullptr detaches
+    void AttachLatencyProbe(LatencyProbe *probe);
+
+    // counts instructions per kind and address, subroutine calls and drawn rows, see
+    // Profile.hpp. Takes over from the recompiler while enabled, and is ignored while
+    // tracing, counting stats or measuring latency. Disabled, nothing of it is compiled
+    // into the plain interpreter
+    void EnableProfiler(bool enabled);
+    Profiler *GetProfiler() const;  // nullptr while disabled
+
+    // asks `debugger` in front of every instruction and stops where it says so, see
+    // Debugger.hpp. Takes over from everything else while attached, nullptr detaches
+    void AttachDebugger(Debugger *debugger);
+
+    // snapshots of the whole machine. Restoring is a copy, only memory pages that
+    // actually differ get their decoded instructions refreshed
+    const Chip8State &GetState() const;
+    void SetState(const Chip8State &state);
+    bool SaveState(const std::string &path) const;
+    bool LoadState(const std::string &path);
+    bool SameState(const Chip8 &other) const;
+
+    // size of the screen in the current mode, 64x32 or 128x64 once a SuperCHIP rom
+    // switches to its extended screen
+    bool IsHires() const;
+    int GetDisplayWidth() const;
+    int GetDisplayHeight() const;
+
+    // `word` 64 pixels of row `y`, the leftmost pixel in the top bit
+    uint64_t GetDisplayRow(int y, int word = 0) const;
+    bool GetPixel(int x, int y) const;
     bool ShouldUpdateDisplay();
+
+    void GetFrame(Frame &frame) const;
+
     bool ShouldBuzz();
 
+    // SetKey is safe to call from another thread, the emulation picks the keys up at
+    // the start of the next batch
     bool GetKey(uint8_t key);
     void SetKey(uint8_t key, bool pressed);
+    // all 16 at once, bit n for key n, as replays feed them back
+    void SetKeys(uint16_t keys);
 
  private:
-    uint16_t opcode;
-    uint8_t memory[MEMORY_SIZE] = {};
-    uint16_t stack[STACK_SIZE] = {};
-
-    uint8_t V[16] = {};  // general purpose registers
-    uint16_t I;     // address register
-    uint16_t pc;    // program counter
-    uint8_t sp;     // stack pointer
-
-    uint8_t dt;     // delay timer
-    uint8_t st;     // sound timer
+    TimerMode timer_mode = TimerMode::kRealTime;
+    uint32_t clock_speed = DEFAULT_CLOCK_SPEED;
+    std::chrono::steady_clock::time_point prev_timer_start;
+    uint32_t CyclesUntilTick() const;
 
-    std::chrono::system_clock::time_point prev_timer_start;
+    std::atomic<uint16_t> input_keys{0};  // written by the input thread, copied into `keys`
 
     bool update_display;
+    template <class Geometry, bool kWrap>
     void DrawSprite(int posx, int posy, int height);
+    template <class Geometry>
+    void Scroll(int down, int right);
+    void ClearDisplay();
+
+    // instruction with its operands already extracted, cached per even address
+    struct Instruction {
+        uint16_t opcode;
+        uint8_t op;     // index into the dispatch table in Interpret()
+        uint8_t x;
+        uint8_t y;
+        uint8_t n;
+        uint8_t kk;
+    };
+    Instruction decoded[MEMORY_SIZE / 2] = {};
+    Instruction unaligned = {};  // scratch entry for jumps to odd addresses
+
+    // decoded instruction kinds, in the same order as the dispatch table in Interpret()
+    enum Op : uint8_t {
+        kNop, kCls, kRet, kJp, kCall, kSeImm, kSneImm, kSeReg, kLdImm, kAddImm,
+        kLdReg, kOr, kAnd, kXor, kAddReg, kSub, kShr, kSubn, kShl, kSneReg,
+        kLdI, kJpV0, kRnd, kDrw, kSkp, kSknp, kLdVxDt, kLdVxK, kLdDtVx, kLdStVx,
+        kAddI, kLdF, kLdB, kLdStore, kLdLoad,
+        kScd, kScr, kScl, kExit, kLow, kHigh, kLdHf, kLdR, kLdVxR,  // SuperCHIP
+    };
+
+    uint8_t Random();
+
+    static Instruction Decode(uint16_t opcode);
+    void RefreshDecoded(uint16_t address, uint16_t length);
+    // bit n set once the WRITE_BLOCK_SIZE bytes of block n have been written or restored,
+    // cleared by Chip8Batch to know which lanes may no longer run the same code as the others
+    uint64_t written_blocks = 0;
+    const Instruction *Fetch();
+    // what the interpreter does around each instruction, each one is its own specialisation
+    // so the plain loop pays nothing for the others
+    enum Hook {
+        kHookNone,
+        kHookTrace,
+        kHookStats,
+        kHookLatency,
+        kHookProfile,
+        kHookDebug,
+    };
+
+    // Loops that only wait for the delay timer or a key. A backward jump over instructions
+    // that touch nothing but registers is a candidate. Once the registers come round the
+    // same at the jump twice in a row, with the same dt and keys, every further turn does
+    // too until a tick or a key press, and those only happen between batches. The
+    // interpreter then skips every whole turn that still fits in its batch
+    enum IdleClass : uint8_t {
+        kIdleUnknown,
+        kIdleCandidate,
+        kIdleNever,
+    };
+    IdleClass idle_class[MEMORY_SIZE / 2] = {};  // per jump address
+
+    struct IdleVisit {
+        uint16_t jump;  // NO_IDLE_JUMP when there is no earlier visit in this batch
+        uint16_t I;
+        uint16_t keys;
+        uint8_t dt;
+        uint8_t V[16];
+        uint32_t executed;
+    };
+    IdleVisit idle_visit = {};
+
+    IdleClass ClassifyLoop(uint16_t jump, uint16_t target) const;
+    // instructions the interpreter can skip at the backward jump `pc`, 0 if it is not idle
+    uint32_t IdleSkip(uint16_t target, uint32_t executed, uint32_t remaining);
+
+    // returns early after switching display mode, so the rest runs in the other instantiation
+    template <Hook kHook, class Geometry, class Quirks>
+    uint32_t Interpret(uint32_t cycles);
+    uint32_t Recompile(uint32_t cycles);
+    // the plain interpreter for the current display mode and quirks
+    uint32_t Fallback(uint32_t cycles);
+
+    QuirkPreset quirks = QuirkPreset::kCosmacVip;
+
+    // the Interpret() specialisation or backend Execute() currently runs, and the plain
+    // one Fallback() runs
+    uint32_t (Chip8::*executor)(uint32_t cycles) = &Chip8::Interpret<kHookNone, LoRes, CosmacVipQuirks>;
+    uint32_t (Chip8::*interpreter)(uint32_t cycles) = &Chip8::Interpret<kHookNone, LoRes, CosmacVipQuirks>;
+    void SelectExecutor();
+    template <class Quirks>
+    void SelectExecutorFor();
+    template <class Geometry, class Quirks>
+    void SelectExecutorFor();
+
+    std::unique_ptr<Recompiler> recompiler;
+    friend class Recompiler;
+    friend class Chip8Batch;
+    friend class ForkArena;
+
+    std::unique_ptr<Tracer> tracer;
+    TraceRecord TraceState(uint16_t address, uint16_t instruction, uint8_t timer, uint8_t sound) const;
+
+    bool stats_enabled = false;
+    ExecStats stats = {};
+
+    LatencyProbe *latency_probe = nullptr;
 
-    // each bit represents a key
-    uint16_t keys;
+    std::unique_ptr<Profiler> profiler;
 
-    bool debug;
+    Debugger *debugger = nullptr;
 };
 
 #endif //CHIP8LER__CHIP8_HPP_
@@ -0,0 +1,922 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+#include "Chip8Batch.hpp"
+
+// one vector of lanes, 8 bits each. AVX2 when the compiler may use it, SSE2 on every
+// other x86-64 build and one lane at a time anywhere else
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+struct Simd {
+    using Reg = __m256i;
+    static constexpr uint32_t kWidth = 32;
+
+    static Reg Load(const uint8_t *p) { return _mm256_loadu_si256(reinterpret_cast<const Reg *>(p)); }
+    static void Store(uint8_t *p, Reg r) { _mm256_storeu_si256(reinterpret_cast<Reg *>(p), r); }
+    static Reg Set(uint8_t value) { return _mm256_set1_epi8(char(value)); }
+    static Reg Add(Reg a, Reg b) { return _mm256_add_epi8(a, b); }
+    static Reg Sub(Reg a, Reg b) { return _mm256_sub_epi8(a, b); }
+    static Reg And(Reg a, Reg b) { return _mm256_and_si256(a, b); }
+    static Reg Or(Reg a, Reg b) { return _mm256_or_si256(a, b); }
+    static Reg Xor(Reg a, Reg b) { return _mm256_xor_si256(a, b); }
+    static Reg AndNot(Reg a, Reg b) { return _mm256_andnot_si256(a, b); }  // ~a & b
+    static Reg Equal(Reg a, Reg b) { return _mm256_cmpeq_epi8(a, b); }
+    // unsigned a > b, flipping the top bit turns it into the signed compare there is
+    static Reg Greater(Reg a, Reg b) { return _mm256_cmpgt_epi8(Xor(a, Set(0x80)), Xor(b, Set(0x80))); }
+    static Reg Select(Reg mask, Reg a, Reg b) { return _mm256_blendv_epi8(b, a, mask); }
+    static Reg ShiftRight(Reg a) { return And(_mm256_srli_epi16(a, 1), Set(0x7F)); }
+};
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+struct Simd {
+    using Reg = __m128i;
+    static constexpr uint32_t kWidth = 16;
+
+    static Reg Load(const uint8_t *p) { return _mm_loadu_si128(reinterpret_cast<const Reg *>(p)); }
+    static void Store(uint8_t *p, Reg r) { _mm_storeu_si128(reinterpret_cast<Reg *>(p), r); }
+    static Reg Set(uint8_t value) { return _mm_set1_epi8(char(value)); }
+    static Reg Add(Reg a, Reg b) { return _mm_add_epi8(a, b); }
+    static Reg Sub(Reg a, Reg b) { return _mm_sub_epi8(a, b); }
+    static Reg And(Reg a, Reg b) { return _mm_and_si128(a, b); }
+    static Reg Or(Reg a, Reg b) { return _mm_or_si128(a, b); }
+    static Reg Xor(Reg a, Reg b) { return _mm_xor_si128(a, b); }
+    static Reg AndNot(Reg a, Reg b) { return _mm_andnot_si128(a, b); }
+    static Reg Equal(Reg a, Reg b) { return _mm_cmpeq_epi8(a, b); }
+    static Reg Greater(Reg a, Reg b) { return _mm_cmpgt_epi8(Xor(a, Set(0x80)), Xor(b, Set(0x80))); }
+    static Reg Select(Reg mask, Reg a, Reg b) { return Or(And(mask, a), AndNot(mask, b)); }
+    static Reg ShiftRight(Reg a) { return And(_mm_srli_epi16(a, 1), Set(0x7F)); }
+};
+#else
+struct Simd {
+    using Reg = uint8_t;
+    static constexpr uint32_t kWidth = 1;
+
+    static Reg Load(const uint8_t *p) { return *p; }
+    static void Store(uint8_t *p, Reg r) { *p = r; }
+    static Reg Set(uint8_t value) { return value; }
+    static Reg Add(Reg a, Reg b) { return a + b; }
+    static Reg Sub(Reg a, Reg b) { return a - b; }
+    static Reg And(Reg a, Reg b) { return a & b; }
+    static Reg Or(Reg a, Reg b) { return a | b; }
+    static Reg Xor(Reg a, Reg b) { return a ^ b; }
+    static Reg AndNot(Reg a, Reg b) { return ~a & b; }
+    static Reg Equal(Reg a, Reg b) { return a == b ? 0xFF : 0; }
+    static Reg Greater(Reg a, Reg b) { return a > b ? 0xFF : 0; }
+    static Reg Select(Reg mask, Reg a, Reg b) { return (mask & a) | (~mask & b); }
+    static Reg ShiftRight(Reg a) { return a >> 1; }
+};
+#endif
+
+static_assert(BATCH_LANE_ALIGN % Simd::kWidth == 0, "lanes must be padded to whole vectors");
+
+// runs `kernel(lane, mask)` for every vector of lanes
+template <class Kernel>
+static inline void ForEachVector(uint32_t lanes, const uint8_t *mask, Kernel kernel) {
+    for (uint32_t lane = 0; lane < lanes; lane += Simd::kWidth)
+        kernel(lane, Simd::Load(mask + lane));
+}
+
+// writes `value` to the lanes in `mask`, leaving the others as they were
+static inline void Put(uint8_t *lanes, Simd::Reg mask, Simd::Reg value) {
+    Simd::Store(lanes, Simd::Select(mask, value, Simd::Load(lanes)));
+}
+
+Chip8Batch::Chip8Batch(uint32_t size) {
+    this->size = size;
+    padded = (size + BATCH_LANE_ALIGN - 1) / BATCH_LANE_ALIGN * BATCH_LANE_ALIGN;
+
+    registers.assign(16 * padded, 0);
+    for (int r = 0; r < 16; r++)
+        V[r] = registers.data() + r * padded;
+
+    I.assign(padded, 0);
+    pc.assign(padded, 0);
+    keys.assign(padded, 0);
+    opcode.assign(padded, 0);
+    sp.assign(padded, 0);
+    dt.assign(padded, 0);
+    st.assign(padded, 0);
+    stack.assign(padded, {});
+    differs.assign(padded, {});
+    rewritten = false;
+
+    executed.assign(padded, 0);
+    mask.assign(padded, 0);
+    taken.assign(padded, 0);
+
+    image.reset(new Chip8());
+    for (uint32_t lane = 0; lane < size; lane++) {
+        lanes.emplace_back(new Chip8());
+        lanes.back()->SetTimerMode(TimerMode::kVirtual);
+    }
+
+    clock_speed = DEFAULT_CLOCK_SPEED;
+    quirks = GetQuirkSet(QuirkPreset::kCosmacVip);
+    Reset();
+}
+
+Chip8Batch::~Chip8Batch() = default;
+
+uint32_t Chip8Batch::Size() const {
+    return size;
+}
+
+bool Chip8Batch::LoadRom(const std::string &path) {
+    if (!image->LoadRom(path)) return false;
+
+    SetQuirks(image->GetQuirks());
+    Reset();
+    return true;
+}
+
+void Chip8Batch::SetQuirks(QuirkPreset preset) {
+    quirks = GetQuirkSet(preset);
+    image->SetQuirks(preset);
+    for (uint32_t lane = 0; lane < size; lane++)
+        lanes[lane]->SetQuirks(preset);
+}
+
+void Chip8Batch::SetClockSpeed(uint32_t instructions_per_second) {
+    clock_speed = std::max<uint32_t>(instructions_per_second, TIMER_FREQUENCY);
+    timer_phase = 0;
+    for (uint32_t lane = 0; lane < size; lane++)
+        lanes[lane]->SetClockSpeed(clock_speed);
+}
+
+void Chip8Batch::Reset() {
+    timer_phase = 0;
+    stats = {};
+
+    // another rom or a fresh start, neither way has been timed on it
+    lockstep = true;
+    lockstep_ns = 0;
+    alone_ns = 0;
+    probe_calls = BATCH_PROBE_CALLS;
+    until_probe = 0;
+
+    for (uint32_t lane = 0; lane < size; lane++)
+        ResetLane(lane, image->GetState());
+}
+
+void Chip8Batch::Reset(uint32_t lane) {
+    ResetLane(lane, image->GetState());
+}
+
+void Chip8Batch::SetState(uint32_t lane, const Chip8State &state) {
+    ResetLane(lane, state);
+}
+
+void Chip8Batch::ResetLane(uint32_t lane, const Chip8State &state) {
+    Chip8 &chip_8 = *lanes[lane];
+    chip_8.SetState(state);
+
+    // compared against the rom from scratch, the lane may have been anywhere before
+    chip_8.written_blocks = ~uint64_t(0);
+    Store(lane);
+    keys[lane] = state.keys;
+}
+
+void Chip8Batch::SetKey(uint32_t lane, uint8_t key, bool pressed) {
+    if (pressed)
+        keys[lane] |= 1 << key;
+    else
+        keys[lane] &= ~(1 << key);
+}
+
+void Chip8Batch::SetKeys(uint32_t lane, uint16_t keys) {
+    this->keys[lane] = keys;
+}
+
+void Chip8Batch::Load(uint32_t lane) const {
+    Chip8 &chip_8 = *lanes[lane];
+    for (int r = 0; r < 16; r++)
+        chip_8.V[r] = V[r][lane];
+
+    memcpy(chip_8.stack, stack[lane].data(), sizeof(chip_8.stack));
+    chip_8.I = I[lane];
+    chip_8.pc = pc[lane];
+    chip_8.keys = keys[lane];
+    chip_8.opcode = opcode[lane];
+    chip_8.timer_phase = timer_phase;
+    chip_8.sp = sp[lane];
+    chip_8.dt = dt[lane];
+    chip_8.st = st[lane];
+}
+
+void Chip8Batch::Store(uint32_t lane) {
+    Chip8 &chip_8 = *lanes[lane];
+    for (int r = 0; r < 16; r++)
+        V[r][lane] = chip_8.V[r];
+
+    memcpy(stack[lane].data(), chip_8.stack, sizeof(chip_8.stack));
+    I[lane] = chip_8.I;
+    pc[lane] = chip_8.pc;
+    opcode[lane] = chip_8.opcode;
+    sp[lane] = chip_8.sp;
+    dt[lane] = chip_8.dt;
+    st[lane] = chip_8.st;
+
+    TakeWritten(lane);
+}
+
+// compares the blocks the lane's Chip8 wrote to against the rom image, instruction by
+// instruction, so data written next to code does not hold the lanes apart
+void Chip8Batch::TakeWritten(uint32_t lane) {
+    Chip8 &chip_8 = *lanes[lane];
+    if (!chip_8.written_blocks) return;
+
+    for (int block = 0; block < MEMORY_SIZE / WRITE_BLOCK_SIZE; block++) {
+        if (!(chip_8.written_blocks >> block & 1)) continue;
+
+        for (int slot = block * WRITE_BLOCK_SIZE / 2; slot < (block + 1) * WRITE_BLOCK_SIZE / 2; slot++) {
+            uint64_t bit = uint64_t(1) << (slot & 63);
+            if (chip_8.decoded[slot].opcode != image->decoded[slot].opcode)
+                differs[lane][slot >> 6] |= bit;
+            else
+                differs[lane][slot >> 6] &= ~bit;
+        }
+    }
+
+    chip_8.written_blocks = 0;
+    rewritten = true;
+}
+
+bool Chip8Batch::Differs(uint32_t lane, uint16_t address) const {
+    return differs[lane][address >> 7] >> (address >> 1 & 63) & 1;
+}
+
+void Chip8Batch::RunCycles(uint32_t cycles) {
+    // now and then the way not taken gets a share of the call, it may have become the
+    // quicker one. A few lanes go on their own for the whole call, as their interpreters
+    // only skip idle loops that come round within one, lockstep gets a slice of it on
+    // every lane, as it only pays off with the lanes together
+    bool probe = until_probe == 0;
+    if (probe && lockstep) {
+        Run(cycles, std::max<uint32_t>(size / BATCH_PROBE_SHARE, 1));
+    } else if (probe) {
+        uint32_t slice = std::max<uint32_t>(cycles / BATCH_PROBE_SHARE, 1);
+        Run(slice, 0);
+        if (cycles > slice) Run(cycles - slice, size);
+    } else {
+        Run(cycles, lockstep ? 0 : size);
+    }
+
+    // each confirmation waits twice as long for the next. A change starts over, it may
+    // be down to one slow call, the machine being busy elsewhere
+    bool quicker = lockstep_ns <= alone_ns;
+    if (quicker != lockstep)
+        probe_calls = BATCH_PROBE_CALLS;
+    else if (probe)
+        probe_calls = std::min(probe_calls * 2, uint32_t(BATCH_MAX_PROBE_CALLS));
+
+    if (probe || quicker != lockstep)
+        until_probe = probe_calls;
+    else
+        until_probe--;
+    lockstep = quicker;
+}
+
+void Chip8Batch::Run(uint32_t cycles, uint32_t alone) {
+    // the same virtual time as Chip8::RunCycles. Every lane runs the same number of
+    // instructions, so the timers tick at the same counts on all of them
+    uint32_t phase = timer_phase;
+    ticks.clear();
+    for (uint32_t done = 0; done < cycles;) {
+        uint32_t chunk = std::min(cycles - done, CyclesUntilTick());
+        done += chunk;
+
+        timer_phase += chunk * TIMER_FREQUENCY;
+        if (timer_phase >= clock_speed) {
+            timer_phase -= clock_speed;
+            ticks.push_back(done);
+        }
+    }
+
+    using Clock = std::chrono::steady_clock;
+    if (alone) {
+        auto start = Clock::now();
+        RunAlone(cycles, alone, phase);
+        alone_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (double(cycles) * alone);
+    }
+
+    if (alone < size) {
+        uint64_t vector_before = stats.vector_instructions;
+        uint64_t lane_before = stats.lane_instructions;
+        auto start = Clock::now();
+        Execute(cycles, alone);
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count()
+                    / (double(cycles) * (size - alone));
+
+        // mostly run lane by lane anyway, lockstep only adds its bookkeeping to that
+        uint64_t vector = stats.vector_instructions - vector_before;
+        uint64_t total = vector + stats.lane_instructions - lane_before;
+        lockstep_ns = vector * BATCH_MIN_VECTOR_SHARE < total ? std::numeric_limits<double>::infinity() : ns;
+    }
+}
+
+void Chip8Batch::RunAlone(uint32_t cycles, uint32_t lanes_alone, uint32_t phase) {
+    for (uint32_t lane = 0; lane < lanes_alone; lane++) {
+        Chip8 &chip_8 = *lanes[lane];
+        Load(lane);
+        chip_8.timer_phase = phase;
+        chip_8.SetKeys(keys[lane]);
+        chip_8.RunCycles(cycles);
+        Store(lane);
+    }
+
+    stats.lane_instructions += uint64_t(cycles) * lanes_alone;
+    stats.alone_instructions += uint64_t(cycles) * lanes_alone;
+}
+
+void Chip8Batch::RunFrame() {
+    RunCycles(CyclesUntilTick());
+}
+
+uint32_t Chip8Batch::CyclesUntilTick() const {
+    return (clock_speed - timer_phase + TIMER_FREQUENCY - 1) / TIMER_FREQUENCY;
+}
+
+bool Chip8Batch::TickAt(uint32_t count) const {
+    return std::binary_search(ticks.begin(), ticks.end(), count);
+}
+
+// instructions `lane` can run before its timers tick or its batch is done
+uint32_t Chip8Batch::UntilTick(uint32_t lane, uint32_t cycles) const {
+    auto next = std::upper_bound(ticks.begin(), ticks.end(), executed[lane]);
+    return (next == ticks.end() ? cycles : *next) - executed[lane];
+}
+
+void Chip8Batch::Advance(uint32_t lane, uint32_t count) {
+    executed[lane] += count;
+    if (TickAt(executed[lane])) {
+        dt[lane] -= dt[lane] > 0;
+        st[lane] -= st[lane] > 0;
+    }
+}
+
+void Chip8Batch::Execute(uint32_t cycles, uint32_t first) {
+    for (uint32_t lane = 0; lane < padded; lane++)
+        executed[lane] = lane >= first && lane < size ? 0 : cycles;  // padding never runs
+
+    for (;;) {
+        // the lane furthest behind leads, every lane about to run the same instruction
+        // comes along whether or not it is as far
+        uint32_t leader = 0;
+        uint32_t running = 0;
+        for (uint32_t lane = 0; lane < padded; lane++) {
+            if (executed[lane] < executed[leader]) leader = lane;
+            running += executed[lane] < cycles;
+        }
+        if (!running) break;
+
+        const Instruction *inst;
+        uint32_t count = Group(leader, cycles, inst);
+
+        // the group runs as one until it splits up. Lanes that have come the same way
+        // tick their timers together on the way, otherwise it stops short of the first
+        // lane's next tick
+        uint32_t steps = 0;
+        bool aligned = true;
+        if (count * BATCH_MIN_GROUP_RATIO >= running && inst) {
+            uint32_t limit = cycles;
+            for (uint32_t lane = 0; lane < size; lane++) {
+                if (!mask[lane]) continue;
+                aligned &= executed[lane] == executed[leader];
+                limit = std::min(limit, UntilTick(lane, cycles));
+            }
+            steps = Lockstep(aligned ? cycles - executed[leader] : limit, aligned);
+        }
+
+        if (steps) {
+            for (uint32_t lane = 0; lane < size; lane++) {
+                if (!mask[lane]) continue;
+                if (aligned)
+                    executed[lane] += steps;
+                else
+                    Advance(lane, steps);
+            }
+        } else if (count * BATCH_MIN_GROUP_RATIO < running) {
+            RunDiverged(leader, cycles);
+        } else {
+            if (inst && (VectorAlu(*inst) || VectorAddress(*inst) || inst->op == Chip8::kNop)) {
+                AdvancePc(2);
+            } else if (inst && VectorSkip(*inst)) {
+                // 2 for every lane in the group and another 2 where the skip is taken
+                for (uint32_t lane = 0; lane < padded; lane++)
+                    pc[lane] += (mask[lane] & 2) + (taken[lane] & 2);
+            } else if (inst && inst->op == Chip8::kJp) {
+                for (uint32_t lane = 0; lane < padded; lane++)
+                    pc[lane] = mask[lane] ? inst->opcode & 0x0FFF : pc[lane];
+            } else {
+                StepGroup(inst);
+                stats.lane_instructions += count;
+                inst = nullptr;
+            }
+
+            for (uint32_t lane = 0; lane < size; lane++) {
+                if (!mask[lane]) continue;
+                if (inst) opcode[lane] = inst->opcode;
+                Advance(lane, 1);
+            }
+            if (inst) stats.vector_instructions += count;
+        }
+    }
+}
+
+// runs the lanes in `mask`, which all start at the same address, for up to `steps`
+// instructions. The program counter is kept once for all of them until they split up,
+// returns how many instructions were run. With `ticking` every lane has run as many
+// instructions as the first and the timers tick along the way
+uint32_t Chip8Batch::Lockstep(uint32_t steps, bool ticking) {
+    uint32_t first = padded;
+    uint32_t members = 0;
+    for (uint32_t lane = 0; lane < padded; lane++) {
+        if (!mask[lane]) continue;
+        first = std::min(first, lane);
+        members++;
+    }
+
+    // instructions some lane has rewritten are checked lane by lane
+    std::array<uint64_t, MEMORY_SIZE / 128> dirty = {};
+    rewritten = true;
+
+    uint16_t at = pc[first];
+    uint16_t last_opcode = opcode[first];
+    auto tick = ticking ? std::upper_bound(ticks.begin(), ticks.end(), executed[first]) : ticks.end();
+
+    uint32_t done = 0;
+    uint32_t vector_steps = 0;
+    bool together = true;
+    while (done < steps && together) {
+        uint16_t address = at & (MEMORY_SIZE - 1);
+        if (at & 0x1) break;
+
+        if (rewritten) {
+            dirty = {};
+            for (uint32_t lane = 0; lane < size; lane++) {
+                if (!mask[lane]) continue;
+                for (size_t word = 0; word < dirty.size(); word++)
+                    dirty[word] |= differs[lane][word];
+            }
+            rewritten = false;
+        }
+
+        const Instruction *agreed = &image->decoded[address >> 1];
+        if (dirty[address >> 7] >> (address >> 1 & 63) & 1) {
+            agreed = Agreed(address);
+            if (!agreed) break;
+        }
+
+        const Instruction &inst = *agreed;
+        bool vector = true;
+        if (VectorAlu(inst) || VectorAddress(inst) || inst.op == Chip8::kNop) {
+            at += 2;
+        } else if (VectorSkip(inst)) {
+            at += 2;
+            if (memcmp(taken.data(), mask.data(), padded) == 0) {
+                at += 2;
+            } else if (std::any_of(taken.begin(), taken.end(), [](uint8_t t) { return t; })) {
+                for (uint32_t lane = 0; lane < padded; lane++)
+                    pc[lane] = mask[lane] ? at + (taken[lane] & 2) : pc[lane];
+                together = false;
+            }
+        } else if (inst.op == Chip8::kJp) {
+            at = inst.opcode & 0x0FFF;
+        } else {
+            // each lane on its own, then see if they still agree on where to go next
+            for (uint32_t lane = 0; lane < padded; lane++)
+                pc[lane] = mask[lane] ? at : pc[lane];
+            StepGroup(&inst);
+            stats.lane_instructions += members;
+            vector = false;
+
+            at = pc[first];
+            for (uint32_t lane = 0; lane < padded; lane++)
+                together &= !mask[lane] || pc[lane] == at;
+        }
+
+        last_opcode = inst.opcode;
+        vector_steps += vector;
+        done++;
+
+        if (tick != ticks.end() && *tick == executed[first] + done) {
+            for (uint32_t lane = 0; lane < padded; lane++) {
+                dt[lane] -= mask[lane] && dt[lane] > 0;
+                st[lane] -= mask[lane] && st[lane] > 0;
+            }
+            ++tick;
+        }
+    }
+
+    // hand the program counter and last opcode back to every lane
+    for (uint32_t lane = 0; lane < padded; lane++) {
+        if (!mask[lane]) continue;
+        if (together) pc[lane] = at;
+        opcode[lane] = last_opcode;
+    }
+
+    stats.vector_instructions += uint64_t(vector_steps) * members;
+    return done;
+}
+
+// the instruction every lane in `mask` has at `address`, nullptr if they differ
+const Chip8::Instruction *Chip8Batch::Agreed(uint16_t address) const {
+    const Instruction *agreed = nullptr;
+
+    for (uint32_t lane = 0; lane < size; lane++) {
+        if (!mask[lane]) continue;
+
+        const Instruction *inst = Differs(lane, address) ? &lanes[lane]->decoded[address >> 1] : &image->decoded[address >> 1];
+        if (!agreed) agreed = inst;
+        else if (inst->opcode != agreed->opcode) return nullptr;
+    }
+
+    return agreed;
+}
+
+// marks every lane that is at the leader's address, still has instructions to run and
+// sees the same opcode there. Lanes that have not rewritten that instruction see the rom
+// image, only the others need their own decoded instructions checked
+uint32_t Chip8Batch::Group(uint32_t leader, uint32_t cycles, const Instruction *&inst) {
+    uint16_t target = pc[leader];
+    uint16_t address = target & (MEMORY_SIZE - 1);
+
+    if (target & 0x1) {
+        // jumps to odd addresses are decoded on the fly, the leader goes on its own
+        std::fill(mask.begin(), mask.end(), 0);
+        mask[leader] = 0xFF;
+        inst = nullptr;
+        return 1;
+    }
+
+    const Instruction *shared = &image->decoded[address >> 1];
+    inst = Differs(leader, address) ? &lanes[leader]->decoded[address >> 1] : shared;
+    bool shared_matches = shared->opcode == inst->opcode;
+
+    uint32_t count = 0;
+    for (uint32_t lane = 0; lane < padded; lane++) {
+        bool same = pc[lane] == target && executed[lane] < cycles;
+        if (same && Differs(lane, address))
+            same = lanes[lane]->decoded[address >> 1].opcode == inst->opcode;
+        else
+            same = same && shared_matches;
+
+        mask[lane] = same ? 0xFF : 0;
+        count += same;
+    }
+
+    return count;
+}
+
+// the group's instruction one lane at a time, straight on the arrays where that is
+// simple and on the lane's own interpreter otherwise
+void Chip8Batch::StepGroup(const Instruction *inst) {
+    for (uint32_t lane = 0; lane < size; lane++) {
+        if (!mask[lane]) continue;
+        if (inst && StepLane(lane, *inst)) continue;
+
+        Load(lane);
+        lanes[lane]->Fallback(1);
+        Store(lane);
+    }
+}
+
+// the same as the interpreter, false for instructions it leaves to Fallback
+bool Chip8Batch::StepLane(uint32_t lane, const Instruction &inst) {
+    Chip8 &chip_8 = *lanes[lane];
+    uint8_t &vx = V[inst.x][lane];
+    uint16_t nnn = inst.opcode & 0x0FFF;
+
+    switch (inst.op) {
+        case Chip8::kCls:
+            chip_8.ClearDisplay();
+            pc[lane] += 2;
+            break;
+        case Chip8::kRet:
+            if (sp[lane] == 0 || sp[lane] > STACK_SIZE) return false;  // over or underflow, as the interpreter does it
+            pc[lane] = stack[lane][--sp[lane]] + 2;
+            break;
+        case Chip8::kCall:
+            if (sp[lane] >= STACK_SIZE) return false;
+            stack[lane][sp[lane]++] = pc[lane];
+            pc[lane] = nnn;
+            break;
+        case Chip8::kJpV0:
+            pc[lane] = nnn + V[quirks.jump_vx ? inst.x : 0x0][lane];
+            break;
+        case Chip8::kRnd:
+            vx = chip_8.Random() & inst.kk;
+            pc[lane] += 2;
+            break;
+        case Chip8::kDrw:
+            if (quirks.wrap_sprites) return false;
+
+            // the sprite and the screen are in the lane, only I has to go over
+            chip_8.I = I[lane];
+            if (chip_8.hires)
+                chip_8.DrawSprite<HiRes, false>(vx, V[inst.y][lane], inst.n);
+            else
+                chip_8.DrawSprite<LoRes, false>(vx, V[inst.y][lane], inst.n);
+            V[0xF][lane] = chip_8.V[0xF];
+            chip_8.update_display = true;
+            pc[lane] += 2;
+            break;
+        case Chip8::kLdVxK:
+            // stays on this instruction until a key is down
+            if (keys[lane]) {
+                int key;
+                for (key = 0; key < 0xF; key++) {
+                    if (uint32_t(keys[lane]) >> key & 0x1u) break;
+                }
+
+                vx = key;
+                pc[lane] += 2;
+            }
+            break;
+        case Chip8::kLdB:
+            chip_8.memory[I[lane] & (MEMORY_SIZE - 1)] = vx / 100;
+            chip_8.memory[(I[lane] + 1) & (MEMORY_SIZE - 1)] = vx / 10 % 10;
+            chip_8.memory[(I[lane] + 2) & (MEMORY_SIZE - 1)] = vx % 10;
+            chip_8.RefreshDecoded(I[lane], 3);
+            TakeWritten(lane);
+            pc[lane] += 2;
+            break;
+        case Chip8::kLdStore:
+            for (int i = 0; i <= inst.x; i++)
+                chip_8.memory[(I[lane] + i) & (MEMORY_SIZE - 1)] = V[i][lane];
+            chip_8.RefreshDecoded(I[lane], inst.x + 1);
+            TakeWritten(lane);
+            if (quirks.index == IndexQuirk::kIncrement) I[lane] += inst.x + 1;
+            if (quirks.index == IndexQuirk::kIncrementByX) I[lane] += inst.x;
+            pc[lane] += 2;
+            break;
+        case Chip8::kLdLoad:
+            for (int i = 0; i <= inst.x; i++)
+                V[i][lane] = chip_8.memory[(I[lane] + i) & (MEMORY_SIZE - 1)];
+            if (quirks.index == IndexQuirk::kIncrement) I[lane] += inst.x + 1;
+            if (quirks.index == IndexQuirk::kIncrementByX) I[lane] += inst.x;
+            pc[lane] += 2;
+            break;
+        default:
+            return false;
+    }
+
+    opcode[lane] = inst.opcode;
+    return true;
+}
+
+// lanes run a stretch on their own interpreter, after which the group is looked for
+// again in case they have come back together. When most of the lanes still share an
+// address only the others go, the rest stay for Lockstep
+void Chip8Batch::RunDiverged(uint32_t leader, uint32_t cycles) {
+    // the address most lanes are at, if any address holds a majority
+    uint16_t common = pc[leader];
+    uint32_t votes = 0;
+    for (uint32_t lane = 0; lane < size; lane++) {
+        if (executed[lane] >= cycles) continue;
+        if (!votes) common = pc[lane];
+        votes += pc[lane] == common ? 1 : -1;
+    }
+
+    uint32_t running = 0;
+    uint32_t sharing = 0;
+    for (uint32_t lane = 0; lane < size; lane++) {
+        if (executed[lane] >= cycles) continue;
+        running++;
+        sharing += pc[lane] == common;
+    }
+    // the leader sharing that address means the lanes there could not be grouped
+    bool keep = sharing * BATCH_MIN_GROUP_RATIO >= running && pc[leader] != common;
+
+    for (uint32_t lane = 0; lane < size; lane++) {
+        if (executed[lane] >= cycles) continue;
+        if (keep && pc[lane] == common) continue;
+
+        Chip8 &chip_8 = *lanes[lane];
+        uint32_t budget = std::min<uint32_t>(cycles - executed[lane], BATCH_DIVERGED_CYCLES);
+        stats.lane_instructions += budget;
+
+        Load(lane);
+        while (budget) {
+            uint32_t chunk = std::min(budget, UntilTick(lane, cycles));
+            chip_8.Execute(chunk);
+            budget -= chunk;
+
+            executed[lane] += chunk;
+            if (TickAt(executed[lane])) chip_8.TickTimers();
+        }
+        Store(lane);
+    }
+}
+
+// each kernel loads its operands again after every store, so x, y and F naming the
+// same register behave exactly as in the interpreter. The shifts read their source once,
+// as it does too
+bool Chip8Batch::VectorAlu(const Instruction &inst) {
+    using Reg = Simd::Reg;
+    uint8_t *vx = V[inst.x];
+    uint8_t *vy = V[inst.y];
+    const uint8_t *shifted = quirks.shift_vy ? vy : vx;
+    uint8_t *vf = V[0xF];
+    const Reg kk = Simd::Set(inst.kk);
+    const Reg one = Simd::Set(1);
+    const Reg high = Simd::Set(0x7F);
+
+    switch (inst.op) {
+        case Chip8::kLdImm:  // LD Vx, kk
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(vx + l, m, kk);
+            });
+            break;
+        case Chip8::kAddImm:  // ADD Vx, kk
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(vx + l, m, Simd::Add(Simd::Load(vx + l), kk));
+            });
+            break;
+        case Chip8::kLdReg:  // LD Vx, Vy
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(vx + l, m, Simd::Load(vy + l));
+            });
+            break;
+        case Chip8::kOr:  // OR Vx, Vy
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(vx + l, m, Simd::Or(Simd::Load(vx + l), Simd::Load(vy + l)));
+            });
+            break;
+        case Chip8::kAnd:  // AND Vx, Vy
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(vx + l, m, Simd::And(Simd::Load(vx + l), Simd::Load(vy + l)));
+            });
+            break;
+        case Chip8::kXor:  // XOR Vx, Vy
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(vx + l, m, Simd::Xor(Simd::Load(vx + l), Simd::Load(vy + l)));
+            });
+            break;
+        case Chip8::kAddReg:  // ADD Vx, Vy - VF is the carry
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(vx + l, m, Simd::Add(Simd::Load(vx + l), Simd::Load(vy + l)));
+                Put(vf + l, m, Simd::And(Simd::Greater(Simd::Load(vy + l), Simd::Load(vx + l)), one));
+            });
+            break;
+        case Chip8::kSub:  // SUB Vx, Vy - VF is not borrow
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(vf + l, m, Simd::AndNot(Simd::Greater(Simd::Load(vy + l), Simd::Load(vx + l)), one));
+                Put(vx + l, m, Simd::Sub(Simd::Load(vx + l), Simd::Load(vy + l)));
+            });
+            break;
+        case Chip8::kShr:  // SHR Vx, Vy
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Reg source = Simd::Load(shifted + l);
+                Put(vx + l, m, Simd::ShiftRight(source));
+                Put(vf + l, m, Simd::And(source, one));
+            });
+            break;
+        case Chip8::kSubn:  // SUBN Vx, Vy
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(vf + l, m, Simd::AndNot(Simd::Greater(Simd::Load(vx + l), Simd::Load(vy + l)), one));
+                Put(vx + l, m, Simd::Sub(Simd::Load(vy + l), Simd::Load(vx + l)));
+            });
+            break;
+        case Chip8::kLdVxDt:  // LD Vx, DT
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(vx + l, m, Simd::Load(&dt[l]));
+            });
+            break;
+        case Chip8::kLdDtVx:  // LD DT, Vx
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(&dt[l], m, Simd::Load(vx + l));
+            });
+            break;
+        case Chip8::kLdStVx:  // LD ST, Vx
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Put(&st[l], m, Simd::Load(vx + l));
+            });
+            break;
+        case Chip8::kShl:  // SHL Vx, Vy
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Reg source = Simd::Load(shifted + l);
+                Put(vx + l, m, Simd::Add(source, source));
+                Put(vf + l, m, Simd::And(Simd::Greater(source, high), one));
+            });
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+bool Chip8Batch::VectorSkip(const Instruction &inst) {
+    using Reg = Simd::Reg;
+    const uint8_t *vx = V[inst.x];
+    const uint8_t *vy = V[inst.y];
+    const Reg kk = Simd::Set(inst.kk);
+
+    switch (inst.op) {
+        case Chip8::kSeImm:  // SE Vx, kk
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Simd::Store(&taken[l], Simd::And(Simd::Equal(Simd::Load(vx + l), kk), m));
+            });
+            break;
+        case Chip8::kSneImm:  // SNE Vx, kk
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Simd::Store(&taken[l], Simd::AndNot(Simd::Equal(Simd::Load(vx + l), kk), m));
+            });
+            break;
+        case Chip8::kSeReg:  // SE Vx, Vy
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Simd::Store(&taken[l], Simd::And(Simd::Equal(Simd::Load(vx + l), Simd::Load(vy + l)), m));
+            });
+            break;
+        case Chip8::kSneReg:  // SNE Vx, Vy
+            ForEachVector(padded, mask.data(), [&](uint32_t l, Reg m) {
+                Simd::Store(&taken[l], Simd::AndNot(Simd::Equal(Simd::Load(vx + l), Simd::Load(vy + l)), m));
+            });
+            break;
+        case Chip8::kSkp:  // SKP Vx
+            for (uint32_t lane = 0; lane < padded; lane++)
+                taken[lane] = mask[lane] & -(uint32_t(keys[lane]) >> (vx[lane] & 0xF) & 0x1u);
+            break;
+        case Chip8::kSknp:  // SKNP Vx
+            for (uint32_t lane = 0; lane < padded; lane++)
+                taken[lane] = mask[lane] & -(~uint32_t(keys[lane]) >> (vx[lane] & 0xF) & 0x1u);
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+// the instructions on I, one lane after the other but without leaving the arrays
+bool Chip8Batch::VectorAddress(const Instruction &inst) {
+    const uint8_t *vx = V[inst.x];
+    uint8_t *vf = V[0xF];
+    uint16_t nnn = inst.opcode & 0x0FFF;
+
+    switch (inst.op) {
+        case Chip8::kLdI:  // LD I, nnn
+            for (uint32_t lane = 0; lane < padded; lane++)
+                I[lane] = mask[lane] ? nnn : I[lane];
+            break;
+        case Chip8::kAddI:  // ADD I, Vx - VF is set when I goes past the end of memory
+            for (uint32_t lane = 0; lane < padded; lane++) {
+                if (!mask[lane]) continue;
+                vf[lane] = vx[lane] + I[lane] > 0xFFF ? 1 : 0;
+                I[lane] += vx[lane];
+            }
+            break;
+        case Chip8::kLdF:  // LD F, Vx
+            for (uint32_t lane = 0; lane < padded; lane++)
+                I[lane] = mask[lane] ? vx[lane] * 0x5 : I[lane];
+            break;
+        case Chip8::kLdHf:  // LD HF, Vx
+            for (uint32_t lane = 0; lane < padded; lane++)
+                I[lane] = mask[lane] ? BIG_FONT_ADDRESS + (vx[lane] & 0xF) * 10 : I[lane];
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+void Chip8Batch::AdvancePc(uint8_t amount) {
+    for (uint32_t lane = 0; lane < padded; lane++)
+        pc[lane] += mask[lane] & amount;
+}
+
+const uint8_t *Chip8Batch::GetRegisters(uint8_t index) const {
+    return V[index & 0xF];
+}
+
+uint16_t Chip8Batch::GetPc(uint32_t lane) const {
+    return pc[lane];
+}
+
+uint8_t Chip8Batch::GetSoundTimer(uint32_t lane) const {
+    return st[lane];
+}
+
+const Chip8State &Chip8Batch::GetState(uint32_t lane) const {
+    Load(lane);
+    return lanes[lane]->GetState();
+}
+
+void Chip8Batch::GetFrame(uint32_t lane, Frame &frame) const {
+    lanes[lane]->GetFrame(frame);
+}
+
+bool Chip8Batch::SameState(uint32_t lane, const Chip8 &other) const {
+    Load(lane);
+    return lanes[lane]->SameState(other);
+}
+
+const BatchStats &Chip8Batch::GetStats() const {
+    return stats;
+}
@@ -0,0 +1,152 @@
+#ifndef CHIP8LER__CHIP8BATCH_HPP_
+#define CHIP8LER__CHIP8BATCH_HPP_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Chip8.hpp"
+
+#define BATCH_LANE_ALIGN 32       // lanes are padded to a multiple of the widest vector
+#define BATCH_MIN_GROUP_RATIO 4   // lockstep continues while the leader's group holds 1/4 of the running lanes
+#define BATCH_DIVERGED_CYCLES 256 // instructions each lane runs on its own once they have drifted apart
+#define BATCH_MIN_VECTOR_SHARE 2  // lockstep is only worth timing while the vector kernels run 1/2 of its instructions
+#define BATCH_PROBE_SHARE 8       // the way not taken is timed on 1/8 of the lanes or of a call
+#define BATCH_PROBE_CALLS 4       // RunCycles calls before it is timed again, doubled while it keeps losing
+#define BATCH_MAX_PROBE_CALLS 1024
+
+// where the lane instructions of a batch went
+struct BatchStats {
+    uint64_t vector_instructions;  // run by the vector kernels, counted once per lane
+    uint64_t lane_instructions;    // run by each lane's own interpreter
+    uint64_t alone_instructions;   // of those, run while lockstep was set aside
+};
+
+// Many machines running the same rom in lockstep. The registers the ALU touches are
+// stored as struct of arrays, register by register across every lane, so one vector
+// instruction executes 8xy*, 7xkk, 6xkk and the skips for 16 or 32 lanes at once.
+// Memory, the display and the decoded instructions stay in a Chip8 per lane, which
+// also runs every other instruction and takes over completely while the lanes'
+// program counters have drifted apart.
+//
+// Lockstep only pays off while the lanes mostly agree, elsewhere it loses to the lanes'
+// own interpreters, which also skip idle loops. RunCycles times both on the batch at
+// hand and keeps the quicker, giving the other a share of a call every so often.
+//
+// Every lane runs exactly the requested number of instructions per call, with the
+// timers ticking as in TimerMode::kVirtual, so a lane ends up where a lone Chip8
+// given the same keys would, whichever way it got there.
+class Chip8Batch {
+ public:
+    explicit Chip8Batch(uint32_t size);
+    ~Chip8Batch();
+
+    uint32_t Size() const;
+
+    // loads the rom into every lane and resets them all to its start, with the quirks
+    // the quirk database has for it
+    bool LoadRom(const std::string &path);
+    void SetQuirks(QuirkPreset preset);
+    void SetClockSpeed(uint32_t instructions_per_second);
+
+    // back to the state right after LoadRom, or to any state
+    void Reset();
+    void Reset(uint32_t lane);
+    void SetState(uint32_t lane, const Chip8State &state);
+
+    void SetKey(uint32_t lane, uint8_t key, bool pressed);
+    void SetKeys(uint32_t lane, uint16_t keys);
+
+    // runs `cycles` instructions on every lane, ticking the timers along the way.
+    // RunFrame runs up to and including the next 60 Hz timer tick
+    void RunCycles(uint32_t cycles);
+    void RunFrame();
+
+    // one register across all lanes, `Size()` entries
+    const uint8_t *GetRegisters(uint8_t index) const;
+    uint16_t GetPc(uint32_t lane) const;
+    uint8_t GetSoundTimer(uint32_t lane) const;
+
+    // the whole machine of one lane, gathered back into a single state
+    const Chip8State &GetState(uint32_t lane) const;
+    void GetFrame(uint32_t lane, Frame &frame) const;
+    bool SameState(uint32_t lane, const Chip8 &other) const;
+
+    const BatchStats &GetStats() const;
+
+ private:
+    using Instruction = Chip8::Instruction;
+
+    uint32_t size;
+    uint32_t padded;  // size rounded up to BATCH_LANE_ALIGN
+
+    // struct of arrays, `padded` entries each
+    std::vector<uint8_t> registers;  // V0 of every lane, then V1...
+    uint8_t *V[16];
+    std::vector<uint16_t> I, pc, keys, opcode;
+    std::vector<uint8_t> sp, dt, st;
+    std::vector<std::array<uint16_t, STACK_SIZE>> stack;  // only used one lane at a time
+    // bit n of a lane is set while the instruction at 2n differs from the rom image
+    std::vector<std::array<uint64_t, MEMORY_SIZE / 128>> differs;
+    bool rewritten;  // some lane's differs changed since Lockstep last looked
+
+    std::vector<std::unique_ptr<Chip8>> lanes;
+    std::unique_ptr<Chip8> image;  // the rom as loaded, decoded once for every lane that has not written to it
+
+    uint32_t clock_speed;
+    uint32_t timer_phase;
+    uint32_t CyclesUntilTick() const;
+
+    // looked at once per group instruction, the lanes' own interpreters are specialised
+    QuirkSet quirks;
+
+    // scratch for Execute
+    std::vector<uint32_t> ticks;     // instruction counts after which the timers tick, ascending
+    std::vector<uint32_t> executed;
+    std::vector<uint8_t> mask;   // 0xFF for lanes in the current group
+    std::vector<uint8_t> taken;  // 0xFF where a skip is taken
+
+    BatchStats stats;
+
+    // how RunCycles runs the lanes, and nanoseconds per lane instruction each way as
+    // last timed, 0 before the first time
+    bool lockstep;
+    double lockstep_ns;
+    double alone_ns;
+    uint32_t probe_calls;  // between timing the way not taken
+    uint32_t until_probe;
+
+    // copy one lane's registers between the arrays and its Chip8
+    void Load(uint32_t lane) const;
+    void Store(uint32_t lane);
+    void ResetLane(uint32_t lane, const Chip8State &state);
+    void TakeWritten(uint32_t lane);
+    bool Differs(uint32_t lane, uint16_t address) const;
+
+    // every lane runs `cycles` instructions, the first `alone` on their own interpreters
+    // and the rest in lockstep, and the time each way took per lane instruction is kept
+    void Run(uint32_t cycles, uint32_t alone);
+    // the lanes from `first` on run `cycles` instructions, ticking their timers at `ticks`
+    void Execute(uint32_t cycles, uint32_t first);
+    // the lanes below `lanes_alone` the same on their own interpreters, starting from timer phase `phase`
+    void RunAlone(uint32_t cycles, uint32_t lanes_alone, uint32_t phase);
+    bool TickAt(uint32_t count) const;
+    uint32_t UntilTick(uint32_t lane, uint32_t cycles) const;
+    void Advance(uint32_t lane, uint32_t count);
+    uint32_t Group(uint32_t leader, uint32_t cycles, const Instruction *&inst);
+    uint32_t Lockstep(uint32_t steps, bool ticking);
+    const Instruction *Agreed(uint16_t address) const;
+    void StepGroup(const Instruction *inst);
+    bool StepLane(uint32_t lane, const Instruction &inst);
+    void RunDiverged(uint32_t leader, uint32_t cycles);
+
+    // the instruction on every lane in `mask`, false if it has no vector kernel
+    bool VectorAlu(const Instruction &inst);
+    bool VectorSkip(const Instruction &inst);
+    bool VectorAddress(const Instruction &inst);
+    void AdvancePc(uint8_t amount);
+};
+
+#endif //CHIP8LER__CHIP8BATCH_HPP_
@@ -0,0 +1,454 @@
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include "Debugger.hpp"
+
+static const char *const register_names[Debugger::kRegisters] = {
+    "V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7", "V8", "V9", "VA", "VB", "VC", "VD", "VE", "VF",
+    "I", "DT", "ST", "SP", "PC",
+};
+
+static const char *const compare_names[] = {"==", "!=", "<", "<=", ">", ">="};
+
+static std::string hex(uint32_t value, int digits) {
+    std::ostringstream out;
+    out << std::hex << std::uppercase << std::setw(digits) << std::setfill('0') << value;
+    return out.str();
+}
+
+// addresses are always hex, with or without 0x
+static bool parse_address(const std::string &text, uint16_t &address) {
+    try {
+        size_t used;
+        unsigned long value = std::stoul(text, &used, 16);
+        if (used != text.size() || value >= MEMORY_SIZE) return false;
+        address = value;
+        return true;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+// numbers are decimal unless they start with 0x, up to `limit`
+static bool parse_number(const std::string &text, uint32_t limit, uint32_t &value) {
+    try {
+        size_t used;
+        bool is_hex = text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X');
+        unsigned long long parsed = std::stoull(text, &used, is_hex ? 16 : 10);
+        if (used != text.size() || parsed > limit || text[0] == '-') return false;
+        value = parsed;
+        return true;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+static bool parse_value(const std::string &text, uint16_t &value) {
+    uint32_t parsed;
+    if (!parse_number(text, 0xFFFF, parsed)) return false;
+    value = parsed;
+    return true;
+}
+
+static bool parse_register(std::string text, uint8_t &reg) {
+    std::transform(text.begin(), text.end(), text.begin(), ::toupper);
+    for (int i = 0; i < Debugger::kRegisters; i++) {
+        if (text == register_names[i]) {
+            reg = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint16_t register_value(const Chip8State &state, uint8_t reg) {
+    switch (reg) {
+        case Debugger::kRegI: return state.I;
+        case Debugger::kRegDt: return state.dt;
+        case Debugger::kRegSt: return state.st;
+        case Debugger::kRegSp: return state.sp;
+        case Debugger::kRegPc: return state.pc;
+        default: return state.V[reg & 0xF];
+    }
+}
+
+// the bytes an instruction reads or writes, false for the ones that leave memory alone
+static bool memory_access(const Chip8State &state, uint16_t opcode, uint16_t &length, bool &write) {
+    uint8_t x = opcode >> 8 & 0xF;
+    switch (opcode & 0xF0FF) {
+        case 0xF033: length = 3; write = true; return true;        // LD B, Vx
+        case 0xF055: length = x + 1; write = true; return true;    // LD [I], Vx
+        case 0xF065: length = x + 1; write = false; return true;   // LD Vx, [I]
+    }
+
+    if ((opcode & 0xF000) == 0xD000) {  // DRW, 16x16 sprites on the extended screen
+        uint8_t n = opcode & 0xF;
+        length = n ? n : (state.hires ? 32 : 16);
+        write = false;
+        return true;
+    }
+    return false;
+}
+
+Debugger::Debugger(Chip8 *chip_8)
+        : chip_8(chip_8), next_number(1), address_map(), any_address(false), read_pages(0), write_pages(0),
+          interrupt(nullptr), resuming(false), stopped(false) {}
+
+Debugger::~Debugger() {
+    chip_8->AttachDebugger(nullptr);
+}
+
+int Debugger::AddBreakpoint(uint16_t address) {
+    breakpoints.push_back({next_number, false, uint16_t(address & (MEMORY_SIZE - 1)), false, {}});
+    Rebuild();
+    return next_number++;
+}
+
+int Debugger::AddBreakpoint(uint16_t address, const Condition &condition) {
+    breakpoints.push_back({next_number, false, uint16_t(address & (MEMORY_SIZE - 1)), true, condition});
+    Rebuild();
+    return next_number++;
+}
+
+int Debugger::AddBreakpoint(const Condition &condition) {
+    breakpoints.push_back({next_number, true, 0, true, condition});
+    Rebuild();
+    return next_number++;
+}
+
+int Debugger::AddWatchpoint(uint16_t first, uint16_t last, bool read, bool write) {
+    first &= MEMORY_SIZE - 1;
+    last &= MEMORY_SIZE - 1;
+    if (last < first) std::swap(first, last);
+
+    watchpoints.push_back({next_number, first, last, read, write});
+    Rebuild();
+    return next_number++;
+}
+
+bool Debugger::Remove(int number) {
+    auto breakpoint = std::find_if(breakpoints.begin(), breakpoints.end(),
+                                   [number](const Breakpoint &b) { return b.number == number; });
+    if (breakpoint != breakpoints.end()) {
+        breakpoints.erase(breakpoint);
+        Rebuild();
+        return true;
+    }
+
+    auto watchpoint = std::find_if(watchpoints.begin(), watchpoints.end(),
+                                   [number](const Watchpoint &w) { return w.number == number; });
+    if (watchpoint != watchpoints.end()) {
+        watchpoints.erase(watchpoint);
+        Rebuild();
+        return true;
+    }
+    return false;
+}
+
+void Debugger::RemoveAll() {
+    breakpoints.clear();
+    watchpoints.clear();
+    Rebuild();
+}
+
+void Debugger::List(std::ostream &out) const {
+    for (const Breakpoint &b : breakpoints) {
+        out << "#" << b.number << " break";
+        if (!b.any_address) out << " " << hex(b.address, 3);
+        if (b.conditional)
+            out << " if " << register_names[b.condition.reg] << " " << compare_names[b.condition.compare] << " "
+                << b.condition.value;
+        out << std::endl;
+    }
+    for (const Watchpoint &w : watchpoints) {
+        out << "#" << w.number << " watch " << hex(w.first, 3) << "-" << hex(w.last, 3) << " "
+            << (w.read ? "r" : "") << (w.write ? "w" : "") << std::endl;
+    }
+}
+
+// the machine only pays for the debugger while there is something to stop at
+void Debugger::Rebuild() {
+    memset(address_map, 0, sizeof(address_map));
+    any_address = false;
+    for (const Breakpoint &b : breakpoints) {
+        if (b.any_address)
+            any_address = true;
+        else
+            address_map[b.address / 64] |= uint64_t(1) << (b.address % 64);
+    }
+
+    read_pages = 0;
+    write_pages = 0;
+    for (const Watchpoint &w : watchpoints) {
+        for (int page = w.first / DEBUG_MEMORY_PAGE; page <= w.last / DEBUG_MEMORY_PAGE; page++) {
+            if (w.read) read_pages |= 1 << page;
+            if (w.write) write_pages |= 1 << page;
+        }
+    }
+
+    resuming = false;  // whatever it stopped in front of, a continue lets through again
+    bool armed = !breakpoints.empty() || !watchpoints.empty();
+    chip_8->AttachDebugger(armed ? this : nullptr);
+}
+
+uint32_t Debugger::Step(uint32_t instructions) {
+    Resume();
+    return chip_8->RunCycles(instructions);
+}
+
+uint64_t Debugger::Continue(uint64_t frames) {
+    Resume();
+    uint64_t ran = 0;
+    while (!stopped && (frames ? ran < frames : !(interrupt && interrupt->load()))) {
+        chip_8->RunFrame();
+        ran++;
+    }
+
+    if (!stopped && !frames) {
+        stopped = true;
+        reason = "interrupted";
+    }
+    return ran;
+}
+
+void Debugger::SetInterrupt(const std::atomic<bool> *flag) {
+    interrupt = flag;
+}
+
+bool Debugger::Stopped() const {
+    return stopped;
+}
+
+const std::string &Debugger::StopReason() const {
+    return reason;
+}
+
+void Debugger::Resume() {
+    stopped = false;
+    resuming = true;
+    reason.clear();
+}
+
+bool Debugger::Stops(const Chip8State &state, uint16_t opcode) {
+    if (resuming) {
+        resuming = false;
+        return false;
+    }
+
+    uint16_t pc = state.pc & (MEMORY_SIZE - 1);
+    if (any_address || address_map[pc / 64] >> (pc % 64) & 0x1) {
+        for (const Breakpoint &b : breakpoints) {
+            if (!b.any_address && b.address != pc) continue;
+            if (b.conditional && !Holds(b.condition, state)) continue;
+
+            stopped = true;
+            reason = "break #" + std::to_string(b.number);
+            return true;
+        }
+    }
+
+    if ((read_pages | write_pages) && Watched(state, opcode)) {
+        stopped = true;
+        return true;
+    }
+    return false;
+}
+
+bool Debugger::Holds(const Condition &condition, const Chip8State &state) const {
+    uint16_t value = register_value(state, condition.reg);
+    switch (condition.compare) {
+        case kEqual: return value == condition.value;
+        case kNotEqual: return value != condition.value;
+        case kLess: return value < condition.value;
+        case kLessEqual: return value <= condition.value;
+        case kGreater: return value > condition.value;
+        case kGreaterEqual: return value >= condition.value;
+    }
+    return false;
+}
+
+// addresses wrap around the end of memory, as the interpreter's do
+bool Debugger::Watched(const Chip8State &state, uint16_t opcode) {
+    uint16_t length;
+    bool write;
+    if (!memory_access(state, opcode, length, write)) return false;
+
+    uint16_t pages = write ? write_pages : read_pages;
+    for (uint16_t i = 0; i < length; i++) {
+        uint16_t address = (state.I + i) & (MEMORY_SIZE - 1);
+        if (!(pages >> (address / DEBUG_MEMORY_PAGE) & 0x1)) continue;
+
+        for (const Watchpoint &w : watchpoints) {
+            if (address < w.first || address > w.last || !(write ? w.write : w.read)) continue;
+
+            uint16_t first = state.I & (MEMORY_SIZE - 1);
+            uint16_t last = (state.I + length - 1) & (MEMORY_SIZE - 1);
+            reason = "watch #" + std::to_string(w.number) + ", " + hex(opcode, 4) + (write ? " writes " : " reads ")
+                     + hex(first, 3) + "-" + hex(last, 3);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Debugger::Help(std::ostream &out) {
+    out << "step [n]                          run n instructions, 1 by default" << std::endl;
+    out << "continue [frames]                 run until something hits, or for that many frames" << std::endl;
+    out << "break <addr> [if <reg> <op> <n>]  stop in front of addr, <op> is one of == != < <= > >=" << std::endl;
+    out << "break if <reg> <op> <n>           stop wherever the condition holds" << std::endl;
+    out << "watch <first> [<last>] [r|w|rw]   stop in front of reads or writes of memory, rw by default" << std::endl;
+    out << "delete [n]                        remove breakpoint or watchpoint n, or all of them" << std::endl;
+    out << "list                              breakpoints and watchpoints" << std::endl;
+    out << "regs                              registers, timers and the stack" << std::endl;
+    out << "mem <addr> [length]               memory dump" << std::endl;
+    out << "set <reg> <n>                     change a register" << std::endl;
+    out << "key <k> down|up                   press or release a key" << std::endl;
+    out << "screen                            the display as text" << std::endl;
+    out << "quit" << std::endl;
+    out << "Addresses are hex, other numbers decimal unless written 0x..." << std::endl;
+}
+
+// reads `<reg> <op> <n>` starting at words[first]
+static bool parse_condition(const std::vector<std::string> &words, size_t first, Debugger::Condition &condition) {
+    if (words.size() != first + 3 || !parse_register(words[first], condition.reg)) return false;
+
+    auto compare = std::find(std::begin(compare_names), std::end(compare_names), words[first + 1]);
+    if (compare == std::end(compare_names)) return false;
+    condition.compare = Debugger::Compare(compare - std::begin(compare_names));
+    return parse_value(words[first + 2], condition.value);
+}
+
+bool Debugger::Command(const std::string &line, std::ostream &out) {
+    std::istringstream in(line);
+    std::vector<std::string> words;
+    for (std::string word; in >> word;)
+        words.push_back(word);
+    if (words.empty()) return true;
+
+    const std::string &command = words[0];
+    const Chip8State &state = chip_8->GetState();
+    uint16_t address, value;
+
+    if (command == "q" || command == "quit") {
+        return false;
+    } else if (command == "h" || command == "help") {
+        Help(out);
+    } else if (command == "s" || command == "step") {
+        uint32_t count = 1;
+        if (words.size() > 1 && !parse_number(words[1], UINT32_MAX, count)) {
+            out << "error: expected step [n]" << std::endl;
+            return true;
+        }
+        uint32_t ran = Step(count);
+        out << "ran " << ran << " at " << hex(chip_8->GetState().pc, 3);
+        if (stopped) out << ": " << reason;
+        out << std::endl;
+    } else if (command == "c" || command == "continue") {
+        uint32_t frames = 0;
+        if (words.size() > 1 && !parse_number(words[1], UINT32_MAX, frames)) {
+            out << "error: expected continue [frames]" << std::endl;
+            return true;
+        }
+        uint64_t ran = Continue(frames);
+        out << "ran " << ran << " frames, " << (stopped ? "stopped" : "now") << " at "
+            << hex(chip_8->GetState().pc, 3);
+        if (stopped) out << ": " << reason;
+        out << std::endl;
+    } else if ((command == "b" || command == "break") && words.size() > 1) {
+        Condition condition;
+        if (words[1] == "if") {
+            if (!parse_condition(words, 2, condition)) {
+                out << "error: expected break if <reg> <op> <n>" << std::endl;
+                return true;
+            }
+            out << "#" << AddBreakpoint(condition) << std::endl;
+        } else if (!parse_address(words[1], address)) {
+            out << "error: bad address " << words[1] << std::endl;
+        } else if (words.size() == 2) {
+            out << "#" << AddBreakpoint(address) << std::endl;
+        } else if (words[2] == "if" && parse_condition(words, 3, condition)) {
+            out << "#" << AddBreakpoint(address, condition) << std::endl;
+        } else {
+            out << "error: expected break <addr> if <reg> <op> <n>" << std::endl;
+        }
+    } else if ((command == "w" || command == "watch") && words.size() > 1) {
+        uint16_t last;
+        size_t next = 2;
+        if (!parse_address(words[1], address)) {
+            out << "error: bad address " << words[1] << std::endl;
+            return true;
+        }
+        last = address;
+        if (words.size() > next && parse_address(words[next], last)) next++;
+
+        std::string kind = words.size() > next ? words[next] : "rw";
+        if (kind != "r" && kind != "w" && kind != "rw") {
+            out << "error: expected r, w or rw" << std::endl;
+            return true;
+        }
+        out << "#" << AddWatchpoint(address, last, kind != "w", kind != "r") << std::endl;
+    } else if (command == "d" || command == "delete") {
+        uint32_t number = 0;
+        if (words.size() == 1)
+            RemoveAll();
+        else if (!parse_number(words[1], INT32_MAX, number) || !Remove(number))
+            out << "error: no #" << words[1] << std::endl;
+    } else if (command == "l" || command == "list") {
+        List(out);
+    } else if (command == "r" || command == "regs") {
+        out << "pc " << hex(state.pc, 3) << "  opcode " << hex(state.opcode, 4) << "  I " << hex(state.I, 3)
+            << "  dt " << int(state.dt) << "  st " << int(state.st) << "  keys " << hex(state.keys, 4) << std::endl;
+        for (int i = 0; i < 16; i++)
+            out << register_names[i] << " " << hex(state.V[i], 2) << (i % 8 == 7 ? "\n" : "  ");
+        out << "stack";
+        for (int i = 0; i < state.sp && i < STACK_SIZE; i++)
+            out << " " << hex(state.stack[i], 3);
+        out << std::endl;
+    } else if ((command == "x" || command == "mem") && words.size() > 1) {
+        uint16_t length = DEBUG_DUMP_WIDTH;
+        if (!parse_address(words[1], address) || (words.size() > 2 && !parse_value(words[2], length))) {
+            out << "error: expected mem <addr> [length]" << std::endl;
+            return true;
+        }
+        for (uint16_t i = 0; i < length; i++) {
+            uint16_t at = (address + i) & (MEMORY_SIZE - 1);
+            if (i % DEBUG_DUMP_WIDTH == 0) out << (i ? "\n" : "") << hex(at, 3) << ":";
+            out << " " << hex(state.memory[at], 2);
+        }
+        out << std::endl;
+    } else if (command == "set" && words.size() == 3) {
+        uint8_t reg;
+        if (!parse_register(words[1], reg) || !parse_value(words[2], value)) {
+            out << "error: expected set <reg> <n>" << std::endl;
+            return true;
+        }
+
+        Chip8State changed = state;
+        switch (reg) {
+            case kRegI: changed.I = value; break;
+            case kRegDt: changed.dt = value; break;
+            case kRegSt: changed.st = value; break;
+            case kRegSp: changed.sp = std::min<uint16_t>(value, STACK_SIZE); break;
+            case kRegPc: changed.pc = value & (MEMORY_SIZE - 1); break;
+            default: changed.V[reg] = value;
+        }
+        chip_8->SetState(changed);
+    } else if (command == "key" && words.size() == 3) {
+        if (!parse_value(words[1], value) || value > 0xF || (words[2] != "down" && words[2] != "up")) {
+            out << "error: expected key <k> down|up" << std::endl;
+            return true;
+        }
+        chip_8->SetKey(value, words[2] == "down");
+    } else if (command == "screen") {
+        for (int y = 0; y < chip_8->GetDisplayHeight(); y++) {
+            for (int x = 0; x < chip_8->GetDisplayWidth(); x++)
+                out << (chip_8->GetPixel(x, y) ? '#' : '.');
+            out << std::endl;
+        }
+    } else {
+        out << "error: unknown command " << line << ", try help" << std::endl;
+    }
+    return true;
+}
@@ -0,0 +1,120 @@
+#ifndef CHIP8LER__DEBUGGER_HPP_
+#define CHIP8LER__DEBUGGER_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Chip8.hpp"
+
+#define DEBUG_MEMORY_PAGE 256  // granularity of the watch bitmaps
+#define DEBUG_DUMP_WIDTH 16    // bytes per line of a memory dump
+
+// Breakpoints and memory watchpoints on a machine. While none are set the machine runs
+// exactly as without a debugger. The first one set attaches the debugger, which swaps
+// in an interpreter that asks it before every instruction. The recompiler, tracing and
+// the other probes are set aside until the last one is removed again.
+//
+// The machine stops in front of the instruction that hit, before any of it has run.
+// That covers the memory Fx33, Fx55 and Fx65 access and the sprite DRW reads.
+class Debugger {
+ public:
+    // what a conditional breakpoint compares, V0 to VF are 0 to 15
+    enum Register : uint8_t {
+        kRegI = 16,
+        kRegDt,
+        kRegSt,
+        kRegSp,
+        kRegPc,
+        kRegisters,
+    };
+
+    enum Compare : uint8_t {
+        kEqual,
+        kNotEqual,
+        kLess,
+        kLessEqual,
+        kGreater,
+        kGreaterEqual,
+    };
+
+    struct Condition {
+        uint8_t reg;  // Register, or 0 to 15
+        Compare compare;
+        uint16_t value;
+    };
+
+    explicit Debugger(Chip8 *chip_8);
+    ~Debugger();
+
+    Debugger(const Debugger &) = delete;
+    Debugger &operator=(const Debugger &) = delete;
+
+    // each returns the number it is listed and removed by. A breakpoint without an
+    // address stops wherever its condition holds
+    int AddBreakpoint(uint16_t address);
+    int AddBreakpoint(uint16_t address, const Condition &condition);
+    int AddBreakpoint(const Condition &condition);
+    int AddWatchpoint(uint16_t first, uint16_t last, bool read, bool write);
+    bool Remove(int number);
+    void RemoveAll();
+    void List(std::ostream &out) const;
+
+    // run until done or until something hits. The instruction the machine stopped in
+    // front of runs first, without stopping there again. Continue with 0 frames runs
+    // until something hits or the interrupt flag is set
+    uint32_t Step(uint32_t instructions);
+    uint64_t Continue(uint64_t frames);
+    void SetInterrupt(const std::atomic<bool> *flag);
+    bool Stopped() const;
+    const std::string &StopReason() const;
+
+    // one line of the command interface, see Help(). False once asked to quit
+    bool Command(const std::string &line, std::ostream &out);
+    static void Help(std::ostream &out);
+
+    // the interpreter asks in front of every instruction while attached
+    bool Stops(const Chip8State &state, uint16_t opcode);
+
+ private:
+    struct Breakpoint {
+        int number;
+        bool any_address;
+        uint16_t address;
+        bool conditional;
+        Condition condition;
+    };
+
+    struct Watchpoint {
+        int number;
+        uint16_t first;
+        uint16_t last;
+        bool read;
+        bool write;
+    };
+
+    Chip8 *chip_8;
+    int next_number;
+    std::vector<Breakpoint> breakpoints;
+    std::vector<Watchpoint> watchpoints;
+
+    // quick filters in front of the lists, rebuilt whenever they change
+    uint64_t address_map[MEMORY_SIZE / 64];
+    bool any_address;
+    uint16_t read_pages;   // bit n for page n
+    uint16_t write_pages;
+
+    const std::atomic<bool> *interrupt;
+    bool resuming;  // let the next instruction through, the machine stopped in front of it
+    bool stopped;
+    std::string reason;
+
+    void Rebuild();
+    bool Holds(const Condition &condition, const Chip8State &state) const;
+    bool Watched(const Chip8State &state, uint16_t opcode);
+    void Resume();
+};
+
+#endif //CHIP8LER__DEBUGGER_HPP_
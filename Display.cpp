@@ -1,3 +1,4 @@
+#include <cstring>
 #include <iostream>
 
 #include "Display.hpp"
@@ -8,6 +9,8 @@ Display::Display(Chip8 *chip_8, const char *title) {
     this->chip_8 = chip_8;
     window = nullptr;
     renderer = nullptr;
+    texture = nullptr;
+    hires_texture = nullptr;
 
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_AUDIO) < 0) {
         err("Failed to initialize SDL");
@@ -18,41 +21,89 @@ Display::Display(Chip8 *chip_8, const char *title) {
         err("Could not create SDL window");
     }
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    // presents wait for vblank, so there is never more than one per refresh
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     if (renderer == nullptr) {
         err("Could not create renderer");
     }
 
-    // Give SDL some extra time to initialize in the system
-    SDL_Delay(1000);
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, LoRes::kWidth, LoRes::kHeight);
+    hires_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, HiRes::kWidth, HiRes::kHeight);
+    if (texture == nullptr || hires_texture == nullptr) {
+        err("Could not create texture");
+    }
 }
 
 Display::~Display() {
+    SDL_DestroyTexture(texture);
+    SDL_DestroyTexture(hires_texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 }
 
-void Display::Draw() {
-    SDL_SetRenderDrawColor(renderer, 0x0, 0x0, 0x0, SDL_ALPHA_OPAQUE);
-    SDL_RenderClear(renderer);
+void Display::Draw(const Frame &frame) {
+    // a mode switch leaves the other texture stale, so it is uploaded whole
+    int height = frame.hires ? HiRes::kHeight : LoRes::kHeight;
+    bool full = !shown_valid || frame.hires != shown.hires;
+
+    uint64_t dirty = 0;
+    for (int y = 0; y < height; y++) {
+        if (full || memcmp(frame.display[y], shown.display[y], sizeof(frame.display[y])) != 0)
+            dirty |= uint64_t(1) << y;
+    }
+    if (!dirty) {
+        // what the frame would show is on screen already, a probe waiting on it is done
+        if (latency_probe) latency_probe->Presented(frame.number);
+        return;
+    }
+
+    SDL_Texture *target = frame.hires ? hires_texture : texture;
+    if (frame.hires)
+        Upload<HiRes>(target, frame, dirty);
+    else
+        Upload<LoRes>(target, frame, dirty);
+
+    shown = frame;
+    shown_valid = true;
+
+    SDL_RenderCopy(renderer, target, nullptr, nullptr);
+    SDL_RenderPresent(renderer);
+
+    if (latency_probe)
+        latency_probe->Presented(frame.number);
+}
+
+template <class Geometry>
+void Display::Upload(SDL_Texture *target, const Frame &frame, uint64_t dirty) {
+    int first = 0;
+    while (!(dirty >> first & 0x1)) first++;
+    int last = Geometry::kHeight - 1;
+    while (!(dirty >> last & 0x1)) last--;
 
-    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, SDL_ALPHA_OPAQUE);
+    // only the rows between the first and last change are uploaded
+    SDL_Rect rows = {0, first, Geometry::kWidth, last - first + 1};
+    void *pixels;
+    int pitch;
 
-    for (int y = 0; y < 32; y++) {
-        for (int x = 0; x < 64; x++) {
-            if (chip_8->display[y][x]) {
-                SDL_Rect point = {x * POINT_SIZE, y * POINT_SIZE, POINT_SIZE, POINT_SIZE};
-                SDL_RenderFillRect(renderer, &point);
+    if (SDL_LockTexture(target, &rows, &pixels, &pitch) != 0) return;
+
+    for (int y = first; y <= last; y++) {
+        auto *line = reinterpret_cast<uint32_t *>(static_cast<uint8_t *>(pixels) + (y - first) * pitch);
+
+        for (int w = 0; w < Geometry::kWords; w++, line += 64) {
+            uint64_t row = frame.display[y][w];
+            for (int x = 0; x < 64; x++, row <<= 1) {
+                line[x] = row >> 63 ? COLOR_ON : COLOR_OFF;
             }
         }
     }
 
-    SDL_RenderPresent(renderer);
+    SDL_UnlockTexture(target);
 }
 
-uint8_t Display::GetKeyIndex(SDL_Keycode keycode) {
-    for (int i = 0; i < sizeof(keymap); i++) {
+int Display::GetKeyIndex(SDL_Keycode keycode) {
+    for (int i = 0; i < 16; i++) {
         if (keycode == keymap[i]) {
             return i;
         }
@@ -63,6 +114,7 @@ uint8_t Display::GetKeyIndex(SDL_Keycode keycode) {
 
 bool Display::HandleInput(bool &running) {
     SDL_Event e;
+    bool changed = false;
 
     while (SDL_PollEvent(&e) != 0) {
         // Handle quitting SDL
@@ -70,16 +122,52 @@ bool Display::HandleInput(bool &running) {
             running = false;
         }
 
+        // Handle emulator hotkeys
+        if (e.type == SDL_KEYDOWN && !e.key.repeat) {
+            if (e.key.keysym.sym == SDLK_F5) hotkey = Hotkey::kSaveState;
+            if (e.key.keysym.sym == SDLK_F9) hotkey = Hotkey::kLoadState;
+            if (e.key.keysym.sym == SDLK_F2) hotkey = Hotkey::kLatencyReport;
+        }
+        if ((e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) && e.key.keysym.sym == SDLK_BACKSPACE) {
+            rewinding = e.type == SDL_KEYDOWN;
+        }
+
         // Handle keypress
         if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) {
-            uint8_t key = GetKeyIndex(e.key.keysym.sym);
+            int key = GetKeyIndex(e.key.keysym.sym);
             if (key >= 0) {
+                if (latency_probe && !e.key.repeat)
+                    latency_probe->KeyEvent();
                 chip_8->SetKey(key, e.type == SDL_KEYDOWN);
+                changed = true;
             }
-
-            return true;
         }
     }
 
-    return false;
+    return changed;
+}
+
+void Display::WaitForEvent(int timeout_ms) {
+    SDL_WaitEventTimeout(nullptr, timeout_ms);
+}
+
+void Display::Wake() {
+    // handled like any other event nothing looks at
+    SDL_Event event = {};
+    event.type = SDL_USEREVENT;
+    SDL_PushEvent(&event);
+}
+
+Hotkey Display::TakeHotkey() {
+    Hotkey pressed = hotkey;
+    hotkey = Hotkey::kNone;
+    return pressed;
+}
+
+bool Display::IsRewinding() const {
+    return rewinding;
+}
+
+void Display::SetLatencyProbe(LatencyProbe *probe) {
+    latency_probe = probe;
 }
@@ -3,24 +3,65 @@
 
 #include <SDL.h>
 #include "Chip8.hpp"
+#include "Latency.hpp"
 
 #define POINT_SIZE 10
+#define COLOR_ON 0xFFFFFFFF    // ARGB
+#define COLOR_OFF 0xFF000000
 #define SCREEN_WIDTH (DISPLAY_WIDTH * POINT_SIZE)
 #define SCREEN_HEIGHT (DISPLAY_HEIGHT * POINT_SIZE)
+#define WAIT_TIMEOUT_MS 100  // longest the main loop blocks without a key or a frame
+
+enum class Hotkey {
+    kNone,
+    kSaveState,  // F5
+    kLoadState,  // F9
+    kLatencyReport,  // F2
+};
 
 class Display {
  public:
     explicit Display(Chip8 *chip_8, const char *title);
     ~Display();
 
-    void Draw();
+    // uploads the rows that differ from the last frame drawn and presents
+    void Draw(const Frame &frame);
+    // handles every pending event, true if any key changed
     bool HandleInput(bool &running);
+    // blocks until there is an event to handle or `timeout_ms` passes, leaving it queued
+    void WaitForEvent(int timeout_ms);
+    // wakes a thread in WaitForEvent, safe to call from any thread
+    static void Wake();
+
+    // last emulator hotkey pressed since the previous call
+    Hotkey TakeHotkey();
+    // true while backspace is held
+    bool IsRewinding() const;
+
+    // timestamps key events and presents for `probe`, nullptr to stop
+    void SetLatencyProbe(LatencyProbe *probe);
  private:
     Chip8 *chip_8;
     SDL_Window *window;
     SDL_Renderer *renderer;
+    // one texel per CHIP-8 pixel, scaled up when copied to the window. Each screen
+    // mode has its own, so switching never reallocates
+    SDL_Texture *texture;
+    SDL_Texture *hires_texture;
+
+    Frame shown = {};  // what the textures hold
+    bool shown_valid = false;
+
+    template <class Geometry>
+    void Upload(SDL_Texture *target, const Frame &frame, uint64_t dirty);
+
+    LatencyProbe *latency_probe = nullptr;
+
+    Hotkey hotkey = Hotkey::kNone;
+    bool rewinding = false;
 
-    uint8_t GetKeyIndex(SDL_Keycode keycode);
+    // index 0-F, or -1 when the key is not on the keypad
+    int GetKeyIndex(SDL_Keycode keycode);
     // these are mappings to index 0-F. Layout should be:
     //      1   2   3   C
     //      4   5   6   D
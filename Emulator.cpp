@@ -0,0 +1,149 @@
+#include <iostream>
+
+#include "Emulator.hpp"
+#include "Profile.hpp"
+
+Emulator::Emulator(Chip8 *chip_8, Audio *audio, const std::string &state_path, LatencyProbe *probe)
+    : chip_8(chip_8), audio(audio), probe(probe), recorder(nullptr), shared(nullptr), capture(nullptr), state_path(state_path), running(false), save_requested(false),
+      load_requested(false), rewinding(false), profile_requested(false), scheduler(chip_8), show_stats(false), on_frame(nullptr), frame_number(0),
+      shared_keys(0) {}
+
+Emulator::~Emulator() {
+    Stop();
+}
+
+void Emulator::Start(SchedulerMode mode, uint32_t instructions_per_second, bool show_stats, void (*on_frame)()) {
+    if (thread.joinable()) return;
+
+    this->show_stats = show_stats;
+    this->on_frame = on_frame;
+    scheduler.SetMode(mode, instructions_per_second);
+
+    // the screen as it is before the first frame runs
+    PublishFrame();
+
+    running = true;
+    thread = std::thread(&Emulator::Run, this);
+}
+
+void Emulator::Stop() {
+    if (!thread.joinable()) return;
+
+    running = false;
+    thread.join();
+    if (audio) audio->SetBuzzing(false);
+}
+
+const Frame *Emulator::TakeFrame() {
+    return frames.Acquire() ? &frames.Front() : nullptr;
+}
+
+void Emulator::RequestSave() {
+    save_requested = true;
+}
+
+void Emulator::RequestLoad() {
+    load_requested = true;
+}
+
+void Emulator::SetRewinding(bool rewinding) {
+    this->rewinding = rewinding;
+}
+
+void Emulator::SetProfileOutput(const std::string &prefix, const std::string &name) {
+    profile_prefix = prefix;
+    profile_name = name;
+}
+
+void Emulator::RequestProfileDump() {
+    profile_requested = true;
+}
+
+void Emulator::SetRecorder(MovieRecorder *recorder) {
+    this->recorder = recorder;
+    scheduler.SetRecorder(recorder);
+}
+
+void Emulator::SetSharedWriter(SharedWriter *shared) {
+    this->shared = shared;
+}
+
+void Emulator::SetCapture(CaptureWriter *capture) {
+    this->capture = capture;
+}
+
+void Emulator::Run() {
+    Chip8State state;
+    SchedulerStats stats;
+
+    while (running.load(std::memory_order_relaxed)) {
+        if (save_requested.exchange(false) && chip_8->SaveState(state_path))
+            std::cout << "Saved state to " << state_path << std::endl;
+
+        if (load_requested.exchange(false) && chip_8->LoadState(state_path)) {
+            std::cout << "Loaded state from " << state_path << std::endl;
+            StopRecording();
+            PublishFrame();
+        }
+
+        if (profile_requested.exchange(false) && chip_8->GetProfiler()
+                && chip_8->GetProfiler()->Write(profile_prefix, profile_name))
+            std::cout << "Wrote profile to " << profile_prefix << ".json and .folded" << std::endl;
+
+        // Step backwards one frame at a time while rewinding, otherwise run and remember the frame
+        if (rewinding.load(std::memory_order_relaxed)) {
+            if (rewind.Pop(state)) {
+                StopRecording();
+                chip_8->SetState(state);
+                PublishFrame();
+            }
+        } else {
+            if (scheduler.RunFrame())
+                PublishFrame();
+            rewind.Push(chip_8->GetState());
+        }
+
+        if (audio) audio->SetBuzzing(chip_8->ShouldBuzz());
+        if (shared) ExchangeShared();
+
+        if (show_stats && scheduler.PollStats(stats)) {
+            std::cout << std::dec << "ips: " << long(stats.instructions_per_second)
+                      << " fps: " << stats.frames_per_second
+                      << " jitter: " << stats.mean_jitter_ms << " ms (max " << stats.max_jitter_ms << " ms)" << std::endl;
+        }
+
+        scheduler.WaitForNextFrame();
+    }
+}
+
+void Emulator::PublishFrame() {
+    Frame &frame = frames.Back();
+    chip_8->GetFrame(frame);
+    frame.number = ++frame_number;
+    if (capture) capture->Push(frame);
+    frames.Publish();
+
+    if (probe) probe->Published(frame.number);
+    if (on_frame) on_frame();
+}
+
+void Emulator::StopRecording() {
+    if (!recorder || !recorder->IsOpen()) return;
+
+    recorder->Close();
+    scheduler.SetRecorder(nullptr);
+    std::cout << "Stopped recording, the machine left the recorded run" << std::endl;
+}
+
+void Emulator::ExchangeShared() {
+    shared->Publish(chip_8->GetState());
+
+    // only keys readers changed are passed on, so they do not fight the keyboard
+    uint16_t keys = shared->Keys();
+    uint16_t changed = keys ^ shared_keys;
+    for (uint8_t key = 0; key < 16; key++) {
+        if (changed >> key & 0x1)
+            chip_8->SetKey(key, keys >> key & 0x1);
+    }
+    shared_keys = keys;
+}
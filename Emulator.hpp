@@ -0,0 +1,85 @@
+#ifndef CHIP8LER__EMULATOR_HPP_
+#define CHIP8LER__EMULATOR_HPP_
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "Audio.hpp"
+#include "Capture.hpp"
+#include "Chip8.hpp"
+#include "Latency.hpp"
+#include "Movie.hpp"
+#include "Rewind.hpp"
+#include "Scheduler.hpp"
+#include "SharedMemory.hpp"
+#include "TripleBuffer.hpp"
+
+// Runs a Chip8 on its own thread, paced by a Scheduler. Finished frames go out through
+// a triple buffer and requests come in through atomics, so the thread presenting and
+// handling input never waits on emulation and the other way around.
+class Emulator {
+ public:
+    // `audio` and `probe` are optional
+    Emulator(Chip8 *chip_8, Audio *audio, const std::string &state_path, LatencyProbe *probe = nullptr);
+    ~Emulator();
+
+    // `on_frame` is called on the emulation thread after every frame published
+    void Start(SchedulerMode mode, uint32_t instructions_per_second, bool show_stats, void (*on_frame)() = nullptr);
+    void Stop();
+
+    // presenting side. Returns the newest frame, or nullptr when nothing changed since the last call
+    const Frame *TakeFrame();
+
+    // input side, picked up at the start of the next emulated frame
+    void RequestSave();
+    void RequestLoad();
+    void SetRewinding(bool rewinding);
+    // writes the Chip8's profile to `prefix`.json and .folded on the emulation thread,
+    // see Profile.hpp. The prefix and name are set once before Start
+    void SetProfileOutput(const std::string &prefix, const std::string &name);
+    void RequestProfileDump();
+    // records every frame into `recorder` from the first one on, set once before Start.
+    // Loading a state or rewinding ends the movie, it could not be replayed past that
+    void SetRecorder(MovieRecorder *recorder);
+    // publishes every frame into `shared` and takes the keys readers hold from it,
+    // next to the ones set on the Chip8 directly. Set once before Start
+    void SetSharedWriter(SharedWriter *shared);
+    // hands every published frame to `capture`, set once before Start
+    void SetCapture(CaptureWriter *capture);
+
+ private:
+    Chip8 *chip_8;
+    Audio *audio;
+    LatencyProbe *probe;
+    MovieRecorder *recorder;
+    SharedWriter *shared;
+    CaptureWriter *capture;
+    std::string state_path;
+    std::string profile_prefix;
+    std::string profile_name;
+
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<bool> save_requested;
+    std::atomic<bool> load_requested;
+    std::atomic<bool> rewinding;
+    std::atomic<bool> profile_requested;
+
+    TripleBuffer<Frame> frames;
+
+    // only used on the emulation thread
+    Scheduler scheduler;
+    RewindBuffer rewind;
+    bool show_stats;
+    void (*on_frame)();
+    uint64_t frame_number;
+    uint16_t shared_keys;  // held through `shared` as of the last frame
+
+    void Run();
+    void PublishFrame();
+    void StopRecording();
+    void ExchangeShared();
+};
+
+#endif //CHIP8LER__EMULATOR_HPP_
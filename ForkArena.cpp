@@ -0,0 +1,200 @@
+#include <cstddef>
+#include <cstring>
+
+#include "ForkArena.hpp"
+
+static_assert(offsetof(Chip8State, memory) == 0 && sizeof(Chip8State::memory) == MEMORY_SIZE,
+              "forks keep memory apart from the rest of the state");
+
+// the part of a state after memory
+static uint8_t *rest_of(Chip8State &state) {
+    return reinterpret_cast<uint8_t *>(&state) + MEMORY_SIZE;
+}
+
+static const uint8_t *rest_of(const Chip8State &state) {
+    return reinterpret_cast<const uint8_t *>(&state) + MEMORY_SIZE;
+}
+
+ForkArena::ForkArena() : live_forks(0) {
+    runner.SetTimerMode(TimerMode::kVirtual);
+    for (uint32_t &page : loaded)
+        page = FORK_NONE;
+}
+
+ForkArena::~ForkArena() = default;
+
+uint32_t ForkArena::Capture(const Chip8 &chip_8) {
+    runner.SetClockSpeed(chip_8.GetClockSpeed());
+    runner.SetQuirks(chip_8.GetQuirks());
+
+    const Chip8State &state = chip_8.GetState();
+    uint32_t id = NewFork();
+    Fork &fork = At(id);
+    for (int p = 0; p < FORK_PAGES; p++) {
+        fork.pages[p] = NewPage();
+        memcpy(Bytes(fork.pages[p]), state.memory + p * STATE_PAGE_SIZE, STATE_PAGE_SIZE);
+    }
+    memcpy(fork.rest, rest_of(state), kRestSize);
+    return id;
+}
+
+uint32_t ForkArena::Clone(uint32_t fork) {
+    uint32_t id = NewFork();
+    Fork &clone = At(id);
+    const Fork &parent = At(fork);  // after NewFork, which may add a chunk but never moves one
+
+    for (int p = 0; p < FORK_PAGES; p++) {
+        clone.pages[p] = parent.pages[p];
+        references[parent.pages[p]]++;
+    }
+    memcpy(clone.rest, parent.rest, kRestSize);
+    return id;
+}
+
+void ForkArena::Release(uint32_t fork) {
+    for (uint32_t page : At(fork).pages)
+        Unreference(page);
+
+    free_forks.push_back(fork);
+    live_forks--;
+}
+
+void ForkArena::SetSeed(uint32_t fork, uint64_t seed) {
+    // xorshift never leaves 0, the same as Chip8::SetSeed
+    uint64_t rng = seed ? seed : DEFAULT_RNG_SEED;
+    memcpy(At(fork).rest + offsetof(Chip8State, rng) - MEMORY_SIZE, &rng, sizeof(rng));
+}
+
+void ForkArena::Advance(const uint32_t *forks, const uint16_t *keys, size_t count, uint32_t frames) {
+    for (size_t i = 0; i < count; i++) {
+        Fork &fork = At(forks[i]);
+        Load(fork);
+        runner.SetKeys(keys ? keys[i] : 0);
+
+        for (uint32_t frame = 0; frame < frames; frame++)
+            runner.RunFrame();
+
+        Store(fork);
+    }
+}
+
+void ForkArena::GetState(uint32_t fork, Chip8State &state) const {
+    const Fork &source = At(fork);
+    for (int p = 0; p < FORK_PAGES; p++)
+        memcpy(state.memory + p * STATE_PAGE_SIZE, Bytes(source.pages[p]), STATE_PAGE_SIZE);
+    memcpy(rest_of(state), source.rest, kRestSize);
+}
+
+void ForkArena::Restore(uint32_t fork, Chip8 &chip_8) const {
+    Chip8State state;
+    GetState(fork, state);
+    chip_8.SetState(state);
+}
+
+uint8_t ForkArena::Read(uint32_t fork, uint16_t address) const {
+    address &= MEMORY_SIZE - 1;
+    return Bytes(At(fork).pages[address / STATE_PAGE_SIZE])[address % STATE_PAGE_SIZE];
+}
+
+size_t ForkArena::Forks() const {
+    return live_forks;
+}
+
+size_t ForkArena::Pages() const {
+    return references.size() - free_pages.size();
+}
+
+ForkArena::Fork &ForkArena::At(uint32_t fork) {
+    return fork_chunks[fork / FORK_CHUNK][fork % FORK_CHUNK];
+}
+
+const ForkArena::Fork &ForkArena::At(uint32_t fork) const {
+    return fork_chunks[fork / FORK_CHUNK][fork % FORK_CHUNK];
+}
+
+uint8_t *ForkArena::Bytes(uint32_t page) {
+    return page_chunks[page / FORK_CHUNK][page % FORK_CHUNK].bytes;
+}
+
+const uint8_t *ForkArena::Bytes(uint32_t page) const {
+    return page_chunks[page / FORK_CHUNK][page % FORK_CHUNK].bytes;
+}
+
+uint32_t ForkArena::NewFork() {
+    if (free_forks.empty()) {
+        uint32_t first = fork_chunks.size() * FORK_CHUNK;
+        fork_chunks.emplace_back(new Fork[FORK_CHUNK]);
+        for (uint32_t i = FORK_CHUNK; i > 0; i--)
+            free_forks.push_back(first + i - 1);
+    }
+
+    uint32_t fork = free_forks.back();
+    free_forks.pop_back();
+    live_forks++;
+    return fork;
+}
+
+uint32_t ForkArena::NewPage() {
+    if (free_pages.empty()) {
+        uint32_t first = page_chunks.size() * FORK_CHUNK;
+        page_chunks.emplace_back(new Page[FORK_CHUNK]);
+        references.resize(first + FORK_CHUNK, 0);
+        for (uint32_t i = FORK_CHUNK; i > 0; i--)
+            free_pages.push_back(first + i - 1);
+    }
+
+    uint32_t page = free_pages.back();
+    free_pages.pop_back();
+    references[page] = 1;
+    return page;
+}
+
+void ForkArena::Unreference(uint32_t page) {
+    if (--references[page]) return;
+
+    free_pages.push_back(page);
+
+    // the number may come back with other bytes, the runner must not take it for loaded
+    for (uint32_t &held : loaded) {
+        if (held == page) held = FORK_NONE;
+    }
+}
+
+// only the pages the runner does not hold already are copied in and decoded, so running
+// the children of one parent in a row mostly copies just the registers and the screen
+void ForkArena::Load(const Fork &fork) {
+    for (int p = 0; p < FORK_PAGES; p++) {
+        if (loaded[p] == fork.pages[p]) continue;
+
+        memcpy(runner.memory + p * STATE_PAGE_SIZE, Bytes(fork.pages[p]), STATE_PAGE_SIZE);
+        runner.RefreshDecoded(p * STATE_PAGE_SIZE, STATE_PAGE_SIZE);
+        loaded[p] = fork.pages[p];
+    }
+
+    memcpy(rest_of(static_cast<Chip8State &>(runner)), fork.rest, kRestSize);
+    runner.written_blocks = 0;
+    runner.SelectExecutor();
+}
+
+// pages written while running are copied out, into the fork's own page when nothing
+// else shares it and into a new one otherwise
+void ForkArena::Store(Fork &fork) {
+    memcpy(fork.rest, rest_of(static_cast<const Chip8State &>(runner)), kRestSize);
+
+    const int blocks = STATE_PAGE_SIZE / WRITE_BLOCK_SIZE;
+    for (int p = 0; p < FORK_PAGES; p++) {
+        if (!(runner.written_blocks >> (p * blocks) & ((uint64_t(1) << blocks) - 1))) continue;
+
+        const uint8_t *bytes = runner.memory + p * STATE_PAGE_SIZE;
+        uint32_t page = fork.pages[p];
+        if (memcmp(Bytes(page), bytes, STATE_PAGE_SIZE) == 0) continue;  // written back the same
+
+        if (references[page] > 1) {
+            references[page]--;
+            page = NewPage();
+            fork.pages[p] = page;
+        }
+        memcpy(Bytes(page), bytes, STATE_PAGE_SIZE);
+        loaded[p] = page;
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef CHIP8LER__FORKARENA_HPP_
+#define CHIP8LER__FORKARENA_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Chip8.hpp"
+
+#define FORK_PAGES (MEMORY_SIZE / STATE_PAGE_SIZE)  // memory pages per fork, shared copy on write
+#define FORK_CHUNK 1024  // forks or pages the arena grows by at once
+#define FORK_NONE 0xFFFFFFFF
+
+// Machine states to search over, cheap to branch. A fork is the registers, timers and
+// screen of a Chip8State plus references to its memory pages. Cloning copies the
+// former and shares the latter, a page is only copied once a fork writes to it, and
+// most roms only ever write to a page or two. Forks and pages come out of chunks that
+// are reused once released, so forking does not touch the heap after warming up.
+//
+// Every fork is a machine of its own, RNG included. Forks run on one machine inside the
+// arena, with the clock speed and quirks of the machine captured last and the timers
+// as in TimerMode::kVirtual. Not thread safe, a search thread should have its own arena.
+class ForkArena {
+ public:
+    ForkArena();
+    ~ForkArena();
+
+    ForkArena(const ForkArena &) = delete;
+    ForkArena &operator=(const ForkArena &) = delete;
+
+    // a fork of the machine as it is now, it shares nothing with it
+    uint32_t Capture(const Chip8 &chip_8);
+    uint32_t Clone(uint32_t fork);
+    void Release(uint32_t fork);
+
+    // gives a fork random numbers of its own from here on, a clone otherwise draws the
+    // same ones as its parent
+    void SetSeed(uint32_t fork, uint64_t seed);
+
+    // runs `count` forks `frames` frames each, fork i with keys[i] held throughout, no
+    // keys when `keys` is nullptr. Forks sharing pages are quickest run one after another
+    void Advance(const uint32_t *forks, const uint16_t *keys, size_t count, uint32_t frames);
+
+    // copies a fork out, into a state or straight into a machine
+    void GetState(uint32_t fork, Chip8State &state) const;
+    void Restore(uint32_t fork, Chip8 &chip_8) const;
+    uint8_t Read(uint32_t fork, uint16_t address) const;
+
+    size_t Forks() const;
+    size_t Pages() const;  // distinct memory pages held by all the forks
+
+ private:
+    // everything in Chip8State after memory, copied as is
+    static constexpr size_t kRestSize = sizeof(Chip8State) - MEMORY_SIZE;
+
+    struct Fork {
+        uint32_t pages[FORK_PAGES];
+        uint8_t rest[kRestSize];
+    };
+
+    struct Page {
+        uint8_t bytes[STATE_PAGE_SIZE];
+    };
+
+    std::vector<std::unique_ptr<Fork[]>> fork_chunks;
+    std::vector<uint32_t> free_forks;
+    size_t live_forks;
+
+    std::vector<std::unique_ptr<Page[]>> page_chunks;
+    std::vector<uint32_t> references;  // per page, free when 0
+    std::vector<uint32_t> free_pages;
+
+    // the machine forks run on, and the page each part of its memory holds right now
+    Chip8 runner;
+    uint32_t loaded[FORK_PAGES];
+
+    Fork &At(uint32_t fork);
+    const Fork &At(uint32_t fork) const;
+    uint8_t *Bytes(uint32_t page);
+    const uint8_t *Bytes(uint32_t page) const;
+
+    uint32_t NewFork();
+    uint32_t NewPage();
+    void Unreference(uint32_t page);
+
+    void Load(const Fork &fork);
+    void Store(Fork &fork);
+};
+
+#endif //CHIP8LER__FORKARENA_HPP_
@@ -0,0 +1,20 @@
+#ifndef CHIP8LER__HASH_HPP_
+#define CHIP8LER__HASH_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ull
+#define FNV_PRIME 0x100000001B3ull
+
+// 64 bit FNV-1a, plenty to tell a few thousand roms apart and cheap enough to run over
+// every rom on each scan
+inline uint64_t Fnv1a(const uint8_t *data, size_t size, uint64_t hash = FNV_OFFSET_BASIS) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+#endif //CHIP8LER__HASH_HPP_
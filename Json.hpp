@@ -0,0 +1,96 @@
+#ifndef CHIP8LER__JSON_HPP_
+#define CHIP8LER__JSON_HPP_
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+
+// `text` as a quoted JSON string, control characters escaped so any rom name survives
+inline std::string JsonString(const std::string &text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[7];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+// reads the JSON string starting at the quote at `at`, undoing what JsonString escaped.
+// `at` ends up past the closing quote
+inline std::string JsonUnquote(const std::string &line, size_t &at) {
+    std::string out;
+    for (at++; at < line.size() && line[at] != '"'; at++) {
+        if (line[at] != '\\' || at + 1 >= line.size()) {
+            out += line[at];
+            continue;
+        }
+
+        switch (line[++at]) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+                // only ever written for control characters, anything wider is not expected
+                out += char(strtoul(line.substr(at + 1, 4).c_str(), nullptr, 16));
+                at += 4;
+                break;
+            default: out += line[at];
+        }
+    }
+    at++;
+    return out;
+}
+
+// Reads the rom lines of a report the tools write one rom per line, each starting with
+// {"name": "...". Gives name -> the value of `field` on that line, strings unquoted
+inline bool ReadBaseline(const std::string &path, const std::string &field, std::map<std::string, std::string> &values) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open baseline: " << path << std::endl;
+        return false;
+    }
+
+    const std::string name_key = "{\"name\": ";
+    const std::string field_key = "\"" + field + "\": ";
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t name = line.find(name_key);
+        if (name == std::string::npos || line.compare(name + name_key.size(), 1, "\"") != 0) continue;
+
+        name += name_key.size();
+        std::string key = JsonUnquote(line, name);
+        size_t value = line.find(field_key, name);
+        if (value == std::string::npos) continue;
+
+        value += field_key.size();
+        if (line.compare(value, 1, "\"") == 0)
+            values[key] = JsonUnquote(line, value);
+        else
+            values[key] = line.substr(value, line.find_first_of(",}", value) - value);
+    }
+
+    return !values.empty();
+}
+
+#endif //CHIP8LER__JSON_HPP_
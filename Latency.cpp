@@ -0,0 +1,158 @@
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+
+#include "Latency.hpp"
+
+static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LatencyHistogram::LatencyHistogram() : buckets(), count(0), max(0) {}
+
+void LatencyHistogram::Add(int64_t nanoseconds) {
+    int bucket = 0;
+    if (nanoseconds >= 1000) {
+        bucket = 1 + int(std::log2(nanoseconds / 1000.0) * LATENCY_BUCKETS_PER_DOUBLING);
+        if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+    }
+
+    buckets[bucket]++;
+    count++;
+    if (nanoseconds > max) max = nanoseconds;
+}
+
+uint64_t LatencyHistogram::Count() const {
+    return count;
+}
+
+int64_t LatencyHistogram::Percentile(double fraction) const {
+    if (!count) return 0;
+
+    uint64_t target = uint64_t(std::ceil(fraction * count));
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += buckets[bucket];
+        if (seen >= target && seen) {
+            int64_t edge = int64_t(1000 * std::exp2(double(bucket) / LATENCY_BUCKETS_PER_DOUBLING));
+            return std::min(edge, max);
+        }
+    }
+
+    return max;
+}
+
+int64_t LatencyHistogram::Max() const {
+    return max;
+}
+
+LatencyProbe::LatencyProbe() : stage(kIdle), timestamps(), key(0), frame(0), polled(0), abandoned(0) {}
+
+// moves the measurement on a stage, only if it is where the caller expects
+bool LatencyProbe::Advance(Stage from, Stage to) {
+    int expected = from;
+    int64_t now = now_ns();
+    if (stage.load(std::memory_order_relaxed) != from) return false;
+
+    timestamps[to].store(now, std::memory_order_relaxed);
+    return stage.compare_exchange_strong(expected, to, std::memory_order_acq_rel);
+}
+
+void LatencyProbe::KeyEvent() {
+    int current = stage.load(std::memory_order_acquire);
+    if (current == kIdle) {
+        Advance(kIdle, kEvent);
+        return;
+    }
+
+    // the key being followed was never looked at, start over with this one
+    int64_t age = now_ns() - timestamps[kEvent].load(std::memory_order_relaxed);
+    if (age > int64_t(LATENCY_TIMEOUT_MS) * 1000000 && stage.compare_exchange_strong(current, kIdle)) {
+        abandoned.fetch_add(1, std::memory_order_relaxed);
+        Advance(kIdle, kEvent);
+    }
+}
+
+void LatencyProbe::KeySet(uint8_t key) {
+    if (stage.load(std::memory_order_relaxed) != kEvent) return;
+
+    this->key.store(key, std::memory_order_relaxed);
+    Advance(kEvent, kSetKey);
+}
+
+void LatencyProbe::Observed(uint8_t key) {
+    if (!(polled.load(std::memory_order_relaxed) >> (key & 0xF) & 0x1))
+        polled.fetch_or(1 << (key & 0xF), std::memory_order_relaxed);
+
+    if (stage.load(std::memory_order_relaxed) != kSetKey) return;
+    if (key != this->key.load(std::memory_order_relaxed)) return;
+
+    Advance(kSetKey, kObserved);
+}
+
+void LatencyProbe::Drawn() {
+    if (stage.load(std::memory_order_relaxed) != kObserved) return;
+
+    Advance(kObserved, kDrawn);
+}
+
+void LatencyProbe::Published(uint64_t number) {
+    if (stage.load(std::memory_order_relaxed) != kDrawn) return;
+
+    frame.store(number, std::memory_order_relaxed);
+    Advance(kDrawn, kPublished);
+}
+
+// frames that were skipped over still count, any later one shows the draw as well
+void LatencyProbe::Presented(uint64_t number) {
+    if (stage.load(std::memory_order_acquire) != kPublished) return;
+    if (number < frame.load(std::memory_order_relaxed)) return;
+
+    timestamps[kPresented].store(now_ns(), std::memory_order_relaxed);
+    int64_t previous = timestamps[kEvent].load(std::memory_order_relaxed);
+    for (int i = kSetKey; i <= kPresented; i++) {
+        int64_t at = timestamps[i].load(std::memory_order_relaxed);
+        histograms[i].Add(at - previous);
+        previous = at;
+    }
+    histograms[kIdle].Add(previous - timestamps[kEvent].load(std::memory_order_relaxed));
+
+    stage.store(kIdle, std::memory_order_release);
+}
+
+uint16_t LatencyProbe::PolledKeys() const {
+    return polled.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyProbe::Completed() const {
+    return histograms[kIdle].Count();
+}
+
+uint64_t LatencyProbe::Abandoned() const {
+    return abandoned.load(std::memory_order_relaxed);
+}
+
+void LatencyProbe::Print(std::ostream &out) const {
+    static const char *names[kStages] = {
+        "event -> present", "", "event -> SetKey", "SetKey -> observed", "observed -> DRW", "DRW -> published",
+        "published -> present",
+    };
+
+    out << std::dec << std::fixed << std::setprecision(3);
+    out << "latency over " << Completed() << " key presses (" << Abandoned() << " never observed), ms" << std::endl;
+    out << std::left << std::setw(20) << "stage" << std::right
+        << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+
+    for (int i = 0; i < kStages; i++) {
+        if (i == kEvent) continue;
+
+        const LatencyHistogram &h = histograms[i];
+        out << std::left << std::setw(20) << names[i] << std::right
+            << std::setw(10) << h.Percentile(0.5) / 1e6
+            << std::setw(10) << h.Percentile(0.99) / 1e6
+            << std::setw(10) << h.Max() / 1e6 << std::endl;
+    }
+
+    out << std::defaultfloat;
+}
@@ -0,0 +1,79 @@
+#ifndef CHIP8LER__LATENCY_HPP_
+#define CHIP8LER__LATENCY_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+#define LATENCY_BUCKETS_PER_DOUBLING 8
+#define LATENCY_BUCKETS (LATENCY_BUCKETS_PER_DOUBLING * 32 + 1)  // 1 us up to over an hour
+#define LATENCY_TIMEOUT_MS 1000  // a key nobody looks at for this long is given up on
+
+// Log scale histogram of durations, about 9% wide buckets starting at 1 us
+class LatencyHistogram {
+ public:
+    LatencyHistogram();
+
+    void Add(int64_t nanoseconds);
+    uint64_t Count() const;
+    // upper edge of the bucket holding the `fraction` quantile, in nanoseconds
+    int64_t Percentile(double fraction) const;
+    int64_t Max() const;
+
+ private:
+    uint64_t buckets[LATENCY_BUCKETS];
+    uint64_t count;
+    int64_t max;
+};
+
+// Follows one key change at a time from the SDL event to the present that shows its
+// effect. The stages are reached in order and each is timestamped by whichever thread
+// gets there, the histograms are only written on the presenting thread.
+class LatencyProbe {
+ public:
+    enum Stage {
+        kIdle,
+        kEvent,      // SDL event received in Display::HandleInput
+        kSetKey,     // handed to Chip8::SetKey
+        kObserved,   // first SKP, SKNP or Fx0A that looked at the key
+        kDrawn,      // first DRW after that
+        kPublished,  // the frame holding that draw was handed to the presenter
+        kPresented,  // a frame at least that new was presented
+        kStages,
+    };
+
+    LatencyProbe();
+
+    // input thread
+    void KeyEvent();
+    void KeySet(uint8_t key);
+    // emulation thread
+    void Observed(uint8_t key);
+    void Drawn();
+    // frame `number` was just handed to the presenter
+    void Published(uint64_t number);
+    // presenting thread, once frame `number` is on screen
+    void Presented(uint64_t number);
+
+    // every key a SKP, SKNP or Fx0A has looked at so far, one bit each
+    uint16_t PolledKeys() const;
+
+    uint64_t Completed() const;
+    uint64_t Abandoned() const;
+    void Print(std::ostream &out) const;
+
+ private:
+    std::atomic<int> stage;
+    std::atomic<int64_t> timestamps[kStages];
+    std::atomic<uint8_t> key;  // the key being followed
+    std::atomic<uint64_t> frame;  // first frame that shows the draw
+    std::atomic<uint16_t> polled;
+
+    // written by the presenting thread only
+    LatencyHistogram histograms[kStages];  // [n] is stage n - 1 to n, [0] is the whole way through
+    std::atomic<uint64_t> abandoned;
+
+    bool Advance(Stage from, Stage to);
+};
+
+#endif //CHIP8LER__LATENCY_HPP_
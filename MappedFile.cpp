@@ -0,0 +1,86 @@
+#include <fstream>
+
+#include "MappedFile.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CHIP8LER_MMAP 1
+#else
+#define CHIP8LER_MMAP 0
+#endif
+
+MappedFile::MappedFile() : data(nullptr), size(0), mapped(false) {}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string &path) {
+    Close();
+
+#if CHIP8LER_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    // directories and devices open fine but are no file to read
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return false;
+    }
+
+    size = info.st_size;
+    if (size) {
+        void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            data = static_cast<const uint8_t *>(address);
+            mapped = true;
+        }
+    }
+    close(fd);
+
+    if (mapped || !size) return true;
+#endif
+
+    // no mmap, or mapping failed, read the file the slow way
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+
+    std::streamoff length = file.tellg();
+    if (length < 0) return false;
+
+    buffer.resize(length);
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(buffer.data()), buffer.size());
+    if (!file) {
+        buffer.clear();
+        return false;
+    }
+
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+void MappedFile::Close() {
+#if CHIP8LER_MMAP
+    if (mapped)
+        munmap(const_cast<uint8_t *>(data), size);
+#endif
+
+    data = nullptr;
+    size = 0;
+    mapped = false;
+    buffer.clear();
+}
+
+const uint8_t *MappedFile::Data() const {
+    return data;
+}
+
+size_t MappedFile::Size() const {
+    return size;
+}
@@ -0,0 +1,32 @@
+#ifndef CHIP8LER__MAPPEDFILE_HPP_
+#define CHIP8LER__MAPPEDFILE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read only view of a whole file. Mapped into memory where the platform allows it so
+// loading a file does not copy it through a stream first, read into a buffer elsewhere.
+class MappedFile {
+ public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool Open(const std::string &path);
+    void Close();
+
+    const uint8_t *Data() const;
+    size_t Size() const;
+
+ private:
+    const uint8_t *data;
+    size_t size;
+    bool mapped;
+    std::vector<uint8_t> buffer;  // only used when the file could not be mapped
+};
+
+#endif //CHIP8LER__MAPPEDFILE_HPP_
@@ -0,0 +1,135 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "Movie.hpp"
+
+uint64_t HashDisplay(const Chip8State &state, uint64_t previous) {
+    // FNV-1a a word at a time over the part of the screen the current mode shows
+    int rows = state.hires ? HIRES_DISPLAY_HEIGHT : DISPLAY_HEIGHT;
+    int words = state.hires ? HIRES_DISPLAY_WIDTH / 64 : DISPLAY_WIDTH / 64;
+
+    uint64_t hash = (previous ^ state.hires) * FNV_PRIME;
+    for (int y = 0; y < rows; y++) {
+        for (int w = 0; w < words; w++)
+            hash = (hash ^ state.display[y][w]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static bool hash_rom(const std::string &path, uint64_t &hash) {
+    MappedFile rom;
+    if (!rom.Open(path)) {
+        std::cerr << "Failed to load rom: " << path << std::endl;
+        return false;
+    }
+
+    hash = Fnv1a(rom.Data(), rom.Size());
+    return true;
+}
+
+MovieRecorder::MovieRecorder() : header(), hash(FNV_OFFSET_BASIS), frames(0) {}
+
+MovieRecorder::~MovieRecorder() {
+    Close();
+}
+
+bool MovieRecorder::Open(const std::string &path, const std::string &rom_path, uint64_t seed) {
+    Close();
+
+    header = {MOVIE_MAGIC, MOVIE_VERSION, sizeof(MovieFrame), 0, 0, {}, 0, seed};
+    if (!hash_rom(rom_path, header.rom_hash)) return false;
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open movie: " << path << std::endl;
+        return false;
+    }
+
+    hash = FNV_OFFSET_BASIS;
+    frames = 0;
+    return true;
+}
+
+void MovieRecorder::Close() {
+    if (file.is_open()) file.close();
+}
+
+bool MovieRecorder::IsOpen() const {
+    return file.is_open();
+}
+
+void MovieRecorder::Frame(const Chip8 &chip_8) {
+    if (!file.is_open()) return;
+
+    if (!frames++) {
+        header.clock_speed = chip_8.GetClockSpeed();
+        header.quirks = uint8_t(chip_8.GetQuirks());
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+
+    const Chip8State &state = chip_8.GetState();
+    hash = HashDisplay(state, hash);
+
+    MovieFrame frame = {state.keys, MovieCheck(hash)};
+    file.write(reinterpret_cast<const char *>(&frame), sizeof(frame));
+}
+
+bool ReplayMovie(const std::string &path, const std::string &rom_path, ReplayResult &result) {
+    MappedFile movie;
+    if (!movie.Open(path)) {
+        std::cerr << "Failed to load movie: " << path << std::endl;
+        return false;
+    }
+
+    MovieHeader header;
+    if (movie.Size() < sizeof(header) || (movie.Size() - sizeof(header)) % sizeof(MovieFrame)) {
+        std::cerr << "Failed to load movie, wrong size: " << path << std::endl;
+        return false;
+    }
+
+    memcpy(&header, movie.Data(), sizeof(header));
+    if (header.magic != MOVIE_MAGIC || header.version != MOVIE_VERSION || header.frame_size != sizeof(MovieFrame)) {
+        std::cerr << "Failed to load movie, unsupported version: " << path << std::endl;
+        return false;
+    }
+
+    uint64_t rom_hash;
+    if (!hash_rom(rom_path, rom_hash)) return false;
+    if (rom_hash != header.rom_hash) {
+        std::cerr << "Failed to replay movie, it was recorded with another rom: " << rom_path << std::endl;
+        return false;
+    }
+
+    Chip8 chip_8;
+    if (!chip_8.LoadRom(rom_path)) return false;
+    chip_8.SetSeed(header.seed);
+    chip_8.SetTimerMode(TimerMode::kVirtual);
+    chip_8.SetClockSpeed(header.clock_speed);
+    chip_8.SetQuirks(QuirkPreset(header.quirks));
+
+    result.frames = (movie.Size() - sizeof(header)) / sizeof(MovieFrame);
+    result.first_mismatch = result.frames;
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (uint64_t i = 0; i < result.frames; i++) {
+        // copied out, the frames are only byte aligned in the mapping
+        MovieFrame frame;
+        memcpy(&frame, movie.Data() + sizeof(header) + i * sizeof(frame), sizeof(frame));
+
+        chip_8.SetKeys(frame.keys);
+        chip_8.RunFrame();
+
+        hash = HashDisplay(chip_8.GetState(), hash);
+        if (MovieCheck(hash) != frame.check) {
+            result.first_mismatch = i;
+            break;
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
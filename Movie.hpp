@@ -0,0 +1,77 @@
+#ifndef CHIP8LER__MOVIE_HPP_
+#define CHIP8LER__MOVIE_HPP_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include "Chip8.hpp"
+
+#define MOVIE_MAGIC 0x564D3843  // "C8MV"
+#define MOVIE_VERSION 1
+
+// everything a replay has to start from besides the rom itself
+struct MovieHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t frame_size;
+    uint32_t clock_speed;
+    uint8_t quirks;  // QuirkPreset, movies from before quirks were kept are all COSMAC VIP ones
+    uint8_t reserved[3];
+    uint64_t rom_hash;  // FNV-1a of the rom file, see Hash.hpp
+    uint64_t seed;
+};
+
+// one 60 Hz frame: the keys held while it ran and the top bits of the rolling display
+// hash after it, see MovieCheck. The hash covers every frame before too, so once a replay goes wrong
+// every later check fails as well and a 16 bit check is plenty
+struct MovieFrame {
+    uint16_t keys;
+    uint16_t check;
+};
+
+static_assert(sizeof(MovieHeader) == 32, "movie headers are written to disk as is");
+static_assert(sizeof(MovieFrame) == 4, "movie frames are written to disk as is");
+
+// the hash of everything shown so far, `previous` being the one before this frame
+uint64_t HashDisplay(const Chip8State &state, uint64_t previous);
+
+// the part of the hash kept per frame. The top bits, the low ones of an FNV product
+// only depend on the low bits of every word, a few columns of the screen
+inline uint16_t MovieCheck(uint64_t hash) {
+    return uint16_t(hash >> 48);
+}
+
+// Writes the frames of a machine that was started from power on with the header's seed
+// and clock speed, as Chip8::RunFrame runs them in TimerMode::kVirtual
+class MovieRecorder {
+ public:
+    MovieRecorder();
+    ~MovieRecorder();
+
+    // the clock speed and quirks are taken from the machine on the first frame
+    bool Open(const std::string &path, const std::string &rom_path, uint64_t seed);
+    void Close();
+    bool IsOpen() const;
+
+    // after every RunFrame
+    void Frame(const Chip8 &chip_8);
+
+ private:
+    std::ofstream file;
+    MovieHeader header;
+    uint64_t hash;
+    uint64_t frames;
+};
+
+struct ReplayResult {
+    uint64_t frames;
+    uint64_t first_mismatch;  // frame number, or `frames` when all of them matched
+    double seconds;
+};
+
+// plays the movie back on a fresh machine without a window, as fast as it goes,
+// checking every frame. False if the movie could not be played at all
+bool ReplayMovie(const std::string &path, const std::string &rom_path, ReplayResult &result);
+
+#endif //CHIP8LER__MOVIE_HPP_
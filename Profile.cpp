@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "Json.hpp"
+#include "Profile.hpp"
+
+// in the order of Chip8::Op
+static const char *op_names[PROFILE_OPS] = {
+    "SYS", "CLS", "RET", "JP", "CALL", "SE Vx, kk", "SNE Vx, kk", "SE Vx, Vy", "LD Vx, kk", "ADD Vx, kk",
+    "LD Vx, Vy", "OR", "AND", "XOR", "ADD Vx, Vy", "SUB", "SHR", "SUBN", "SHL", "SNE Vx, Vy",
+    "LD I, nnn", "JP V0, nnn", "RND", "DRW", "SKP", "SKNP", "LD Vx, DT", "LD Vx, K", "LD DT, Vx", "LD ST, Vx",
+    "ADD I, Vx", "LD F, Vx", "LD B, Vx", "LD [I], Vx", "LD Vx, [I]",
+    "SCD", "SCR", "SCL", "EXIT", "LOW", "HIGH", "LD HF, Vx", "LD R, Vx", "LD Vx, R",
+};
+
+static std::string hex_address(uint16_t address) {
+    std::ostringstream out;
+    out << "0x" << std::hex << std::uppercase << std::setw(3) << std::setfill('0') << address;
+    return out.str();
+}
+
+Profiler::Profiler() {
+    Reset();
+}
+
+void Profiler::Call(uint16_t target) {
+    target &= MEMORY_SIZE - 1;
+    calls[target]++;
+
+    if (frames.size() == PROFILE_MAX_DEPTH) {
+        untracked++;
+        return;
+    }
+    frames.push_back({target, node, instructions});
+
+    uint64_t key = uint64_t(node) << 16 | target;
+    auto child = children.find(key);
+    if (child != children.end()) {
+        node = child->second;
+    } else if (nodes.size() < PROFILE_MAX_NODES) {
+        nodes.push_back({node, target, 0});
+        node = children[key] = nodes.size() - 1;
+    }
+}
+
+void Profiler::Return() {
+    if (untracked) {
+        untracked--;
+        return;
+    }
+    // a RET with nothing to return to, the rom is off the end of its stack
+    if (frames.empty()) return;
+
+    Frame frame = frames.back();
+    frames.pop_back();
+    inclusive[frame.target] += instructions - frame.start;
+    node = frame.caller;
+}
+
+void Profiler::Reset() {
+    instructions = 0;
+    std::fill(std::begin(ops), std::end(ops), 0);
+    std::fill(std::begin(pcs), std::end(pcs), 0);
+    draws = 0;
+    rows_drawn = 0;
+    std::fill(std::begin(calls), std::end(calls), 0);
+    std::fill(std::begin(inclusive), std::end(inclusive), 0);
+
+    // calls already under way are forgotten, their RETs are ignored like any unmatched one
+    frames.clear();
+    untracked = 0;
+    nodes.assign(1, {0, 0, 0});
+    children.clear();
+    node = 0;
+}
+
+void Profiler::WriteJson(std::ostream &out, const std::string &name) const {
+    // subroutines still running count up to now
+    std::vector<uint64_t> open(MEMORY_SIZE);
+    for (const Frame &frame : frames)
+        open[frame.target] += instructions - frame.start;
+
+    std::vector<uint16_t> hot, subroutines;
+    for (uint16_t address = 0; address < MEMORY_SIZE; address++) {
+        if (pcs[address]) hot.push_back(address);
+        if (calls[address]) subroutines.push_back(address);
+    }
+    std::sort(hot.begin(), hot.end(), [this](uint16_t a, uint16_t b) { return pcs[a] > pcs[b]; });
+    std::sort(subroutines.begin(), subroutines.end(), [&](uint16_t a, uint16_t b) {
+        return inclusive[a] + open[a] > inclusive[b] + open[b];
+    });
+
+    out << "{\n";
+    out << "  \"name\": " << JsonString(name) << ",\n";
+    out << "  \"instructions\": " << instructions << ",\n";
+    out << "  \"draws\": " << draws << ",\n";
+    out << "  \"rows_drawn\": " << rows_drawn << ",\n";
+
+    out << "  \"opcodes\": {";
+    bool first = true;
+    for (int op = 0; op < PROFILE_OPS; op++) {
+        if (!ops[op]) continue;
+        out << (first ? "\n" : ",\n") << "    \"" << op_names[op] << "\": " << ops[op];
+        first = false;
+    }
+    out << "\n  },\n";
+
+    out << "  \"pcs\": [\n";
+    for (size_t i = 0; i < hot.size(); i++) {
+        out << "    {\"pc\": \"" << hex_address(hot[i]) << "\", \"count\": " << pcs[hot[i]] << "}"
+            << (i + 1 < hot.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n";
+
+    out << "  \"calls\": [\n";
+    for (size_t i = 0; i < subroutines.size(); i++) {
+        uint16_t target = subroutines[i];
+        out << "    {\"target\": \"" << hex_address(target) << "\", \"calls\": " << calls[target]
+            << ", \"inclusive\": " << inclusive[target] + open[target] << "}"
+            << (i + 1 < subroutines.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+void Profiler::WriteFolded(std::ostream &out, const std::string &name) const {
+    for (uint32_t i = 0; i < nodes.size(); i++) {
+        if (!nodes[i].self) continue;
+
+        std::vector<uint16_t> stack;
+        for (uint32_t n = i; n; n = nodes[n].parent)
+            stack.push_back(nodes[n].target);
+
+        out << name;
+        for (auto target = stack.rbegin(); target != stack.rend(); ++target)
+            out << ";" << hex_address(*target);
+        out << " " << nodes[i].self << "\n";
+    }
+}
+
+bool Profiler::Write(const std::string &prefix, const std::string &name) const {
+    std::ofstream json(prefix + ".json");
+    std::ofstream folded(prefix + ".folded");
+    if (!json.is_open() || !folded.is_open()) {
+        std::cerr << "Failed to write profile: " << prefix << std::endl;
+        return false;
+    }
+
+    WriteJson(json, name);
+    WriteFolded(folded, name);
+    return json.good() && folded.good();
+}
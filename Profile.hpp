@@ -0,0 +1,76 @@
+#ifndef CHIP8LER__PROFILE_HPP_
+#define CHIP8LER__PROFILE_HPP_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Chip8.hpp"
+
+#define PROFILE_OPS 44             // decoded instruction kinds, see Chip8::Op
+#define PROFILE_MAX_NODES (1 << 16)  // distinct call stacks kept apart, deeper ones are folded into their parent
+#define PROFILE_MAX_DEPTH 64       // calls followed, roms that never return keep growing the stack otherwise
+
+// Where a rom spends its instructions, counted by the profiling hook of the interpreter:
+// per instruction kind, per address, per subroutine with everything it calls, per call
+// stack for flame graphs, and sprite rows drawn. Only touched from the emulation thread.
+class Profiler {
+ public:
+    Profiler();
+
+    // called by the interpreter before each instruction, and around CALL, RET and DRW
+    void Count(uint8_t op, uint16_t pc) {
+        instructions++;
+        ops[op]++;
+        pcs[pc & (MEMORY_SIZE - 1)]++;
+        nodes[node].self++;
+    }
+    void Call(uint16_t target);
+    void Return();
+    void Drawn(int rows) {
+        draws++;
+        rows_drawn += rows;
+    }
+
+    void Reset();
+
+    // `name` labels the bottom of every stack, the rom usually
+    void WriteJson(std::ostream &out, const std::string &name) const;
+    // one "name;0x2A4;0x31C count" line per call stack, as flamegraph.pl and speedscope read them
+    void WriteFolded(std::ostream &out, const std::string &name) const;
+    // both of the above next to each other, as `prefix`.json and `prefix`.folded
+    bool Write(const std::string &prefix, const std::string &name) const;
+
+ private:
+    uint64_t instructions;
+    uint64_t ops[PROFILE_OPS];
+    uint64_t pcs[MEMORY_SIZE];
+    uint64_t draws;
+    uint64_t rows_drawn;
+
+    // per subroutine address
+    uint64_t calls[MEMORY_SIZE];
+    uint64_t inclusive[MEMORY_SIZE];  // instructions from the CALL up to the matching RET
+
+    struct Frame {
+        uint16_t target;
+        uint32_t caller;  // node to go back to on RET
+        uint64_t start;   // `instructions` at the call
+    };
+    std::vector<Frame> frames;
+    uint32_t untracked;  // calls past PROFILE_MAX_DEPTH still waiting for their RET
+
+    // call stacks as a tree, node 0 is the rom's entry point
+    struct Node {
+        uint32_t parent;
+        uint16_t target;
+        uint64_t self;  // instructions run with exactly this stack
+    };
+    std::vector<Node> nodes;
+    std::unordered_map<uint64_t, uint32_t> children;  // parent << 16 | target -> node
+    uint32_t node;
+};
+
+#endif //CHIP8LER__PROFILE_HPP_
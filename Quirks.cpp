@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <iterator>
+
+#include "Hash.hpp"
+#include "Quirks.hpp"
+
+namespace {
+
+struct QuirkEntry {
+    uint64_t hash;  // FNV-1a of the rom
+    QuirkPreset preset;
+};
+
+// roms that misbehave on the original interpreter, sorted by hash. Anything not listed
+// runs as on the COSMAC VIP
+const QuirkEntry kQuirkDatabase[] = {
+    {0x0fd332d0bc68c9f2ull, QuirkPreset::kSuperChip},  // Blinky [Hans Christian Egeberg, 1991]
+    {0x3f58eb4fa83dcd98ull, QuirkPreset::kChip48},     // Hidden [David Winter, 1996]
+    {0x56049e83866b207dull, QuirkPreset::kChip48},     // Tic-Tac-Toe [David Winter]
+    {0x618a84f06fe32861ull, QuirkPreset::kChip48},     // Space Invaders [David Winter]
+    {0x6b6138cc30a48219ull, QuirkPreset::kSuperChip},  // BMP Viewer - Hello (C8 example) [Hap, 2005]
+    {0x81d773ea7eb667bdull, QuirkPreset::kSuperChip},  // Blinky [Hans Christian Egeberg] (alt)
+    {0x8e547ebb12c026b4ull, QuirkPreset::kChip48},     // Space Invaders [David Winter] (alt)
+    {0xaaaf94c34c57a001ull, QuirkPreset::kSuperChip},  // Keypad Test [Hap, 2006]
+    {0xadf99268db3c3bc9ull, QuirkPreset::kChip48},     // Connect 4 [David Winter]
+};
+
+}
+
+QuirkSet GetQuirkSet(QuirkPreset preset) {
+    switch (preset) {
+        case QuirkPreset::kChip48: return Chip48Quirks::kSet;
+        case QuirkPreset::kSuperChip: return SuperChipQuirks::kSet;
+        default: return CosmacVipQuirks::kSet;
+    }
+}
+
+const char *QuirkPresetName(QuirkPreset preset) {
+    switch (preset) {
+        case QuirkPreset::kChip48: return "chip48";
+        case QuirkPreset::kSuperChip: return "schip";
+        default: return "vip";
+    }
+}
+
+bool ParseQuirkPreset(const std::string &name, QuirkPreset &preset) {
+    for (QuirkPreset candidate : {QuirkPreset::kCosmacVip, QuirkPreset::kChip48, QuirkPreset::kSuperChip}) {
+        if (name == QuirkPresetName(candidate)) {
+            preset = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LookupQuirks(const uint8_t *rom, size_t size, QuirkPreset &preset) {
+    uint64_t hash = Fnv1a(rom, size);
+    auto found = std::lower_bound(std::begin(kQuirkDatabase), std::end(kQuirkDatabase), hash,
+                                  [](const QuirkEntry &entry, uint64_t hash) { return entry.hash < hash; });
+    if (found == std::end(kQuirkDatabase) || found->hash != hash) return false;
+
+    preset = found->preset;
+    return true;
+}
@@ -0,0 +1,59 @@
+#ifndef CHIP8LER__QUIRKS_HPP_
+#define CHIP8LER__QUIRKS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// the CHIP-8 variants roms were written for, in the order they came out. The first one
+// is what a machine runs unless the quirk database or the user says otherwise
+enum class QuirkPreset : uint8_t {
+    kCosmacVip,  // the original interpreter
+    kChip48,     // HP-48 port, most roms from the early 90s
+    kSuperChip,  // SuperCHIP 1.1
+};
+
+// what Fx55 and Fx65 leave in I
+enum class IndexQuirk : uint8_t {
+    kIncrement,      // I + x + 1, past the last register
+    kIncrementByX,   // I + x, CHIP-48 was off by one
+    kUnchanged,
+};
+
+// the same choices as plain values, for code that looks them up per instruction rather
+// than being specialised on them
+struct QuirkSet {
+    bool shift_vy;
+    IndexQuirk index;
+    bool jump_vx;
+    bool wrap_sprites;
+};
+
+// Behaviour of the instructions the variants disagree on, as compile-time parameters so
+// every preset gets an interpreter of its own with the choices folded in
+template <bool shift_vy, IndexQuirk index, bool jump_vx, bool wrap_sprites>
+struct QuirkPolicy {
+    static constexpr bool kShiftVy = shift_vy;  // 8xy6/8xyE shift Vy into Vx, otherwise Vx in place
+    static constexpr IndexQuirk kIndex = index;
+    static constexpr bool kJumpVx = jump_vx;  // Bxnn jumps to xnn + Vx rather than nnn + V0
+    // sprites running off an edge come back on the other side rather than being clipped,
+    // none of the presets do
+    static constexpr bool kWrapSprites = wrap_sprites;
+    static constexpr QuirkSet kSet = {shift_vy, index, jump_vx, wrap_sprites};
+};
+
+using CosmacVipQuirks = QuirkPolicy<true, IndexQuirk::kIncrement, false, false>;
+using Chip48Quirks = QuirkPolicy<false, IndexQuirk::kIncrementByX, true, false>;
+using SuperChipQuirks = QuirkPolicy<false, IndexQuirk::kUnchanged, true, false>;
+
+QuirkSet GetQuirkSet(QuirkPreset preset);
+
+// "vip", "chip48" and "schip", as taken on the command line
+const char *QuirkPresetName(QuirkPreset preset);
+bool ParseQuirkPreset(const std::string &name, QuirkPreset &preset);
+
+// the preset known to suit a rom, looked up by the FNV-1a of its bytes (see Hash.hpp).
+// False for roms not in the database
+bool LookupQuirks(const uint8_t *rom, size_t size, QuirkPreset &preset);
+
+#endif //CHIP8LER__QUIRKS_HPP_
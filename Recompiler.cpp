@@ -0,0 +1,370 @@
+#include <cstring>
+#include <initializer_list>
+
+#include "Recompiler.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define RECOMPILER_X86_64 1
+#include <sys/mman.h>
+#else
+#define RECOMPILER_X86_64 0
+#endif
+
+// upper bound on the code emitted for one block, checked before compiling
+#define RECOMPILER_BLOCK_BYTES 4096
+
+namespace {
+
+// registers as encoded in the ModRM reg field
+enum Reg { kAl = 0, kCl = 1, kDl = 2 };
+
+struct Emitter {
+    uint8_t *out;
+
+    void Byte(uint8_t b) { *out++ = b; }
+
+    void Bytes(std::initializer_list<uint8_t> bytes) {
+        for (uint8_t b : bytes) Byte(b);
+    }
+
+    void Imm16(uint16_t value) { memcpy(out, &value, 2); out += 2; }
+    void Imm32(uint32_t value) { memcpy(out, &value, 4); out += 4; }
+    void Imm64(uint64_t value) { memcpy(out, &value, 8); out += 8; }
+
+    // <opcode> reg, [rbx + disp] (or the reverse, depending on the opcode)
+    void Mem(uint8_t opcode, int reg, int32_t disp) {
+        Byte(opcode);
+        Byte(0x80 | reg << 3 | 0x3);
+        Imm32(disp);
+    }
+
+    void Load8(int reg, int32_t disp) { Mem(0x8A, reg, disp); }
+    void Store8(int32_t disp, int reg) { Mem(0x88, reg, disp); }
+
+    void Store16(int32_t disp, uint16_t value) {
+        Byte(0x66);
+        Mem(0xC7, 0, disp);
+        Imm16(value);
+    }
+
+    void SetFlag(uint8_t setcc, int32_t disp) {
+        Bytes({0x0F, setcc, 0xC2});  // set<cc> dl
+        Store8(disp, kDl);
+    }
+
+    // pc = condition ? address + 4 : address + 2, from flags that are already set
+    void Skip(uint8_t cmovcc, int32_t pc_disp, uint16_t address) {
+        Byte(0xB8);  // mov eax, address + 2
+        Imm32(address + 2);
+        Byte(0xBA);  // mov edx, address + 4
+        Imm32(address + 4);
+        Bytes({0x0F, cmovcc, 0xC2});  // cmov<cc> eax, edx
+        Byte(0x66);
+        Mem(0x89, kAl, pc_disp);
+    }
+};
+
+}
+
+Recompiler::Recompiler(Chip8 *chip_8) {
+    this->chip_8 = chip_8;
+    code_pages = 0;
+    arena = nullptr;
+    arena_used = 0;
+
+#if RECOMPILER_X86_64
+    // never writable and executable at once, Compile switches it over around each block
+    void *mapping = mmap(nullptr, RECOMPILER_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping != MAP_FAILED)
+        arena = static_cast<uint8_t *>(mapping);
+#endif
+}
+
+Recompiler::~Recompiler() {
+#if RECOMPILER_X86_64
+    if (arena)
+        munmap(arena, RECOMPILER_ARENA_SIZE);
+#endif
+}
+
+bool Recompiler::IsSupported() {
+    return RECOMPILER_X86_64;
+}
+
+uint32_t Recompiler::Execute(uint32_t cycles) {
+    uint32_t executed = 0;
+
+    while (executed < cycles) {
+        uint16_t pc = chip_8->pc;
+        if (pc & 0x1 || pc >= MEMORY_SIZE) {
+            executed += chip_8->Fallback(1);
+            continue;
+        }
+
+        Block *block = &blocks[pc];
+        if (!block->code && !Compile(pc)) {
+            executed += chip_8->Fallback(1);
+            continue;
+        }
+
+        // never overshoot the budget, so the timers tick on the same instruction as
+        // they would in the interpreter
+        uint16_t length = block->length;
+        if (length > cycles - executed) {
+            executed += chip_8->Fallback(cycles - executed);
+            break;
+        }
+
+        block->code(chip_8);
+        executed += length;
+    }
+
+    return executed;
+}
+
+void Recompiler::Invalidate(uint16_t address, uint16_t length) {
+    uint32_t end = address + length;
+
+    uint16_t pages = 0;
+    for (uint32_t page = address >> 8; page <= (end - 1) >> 8 && page < MEMORY_SIZE >> 8; page++)
+        pages |= 1 << page;
+
+    if (!(code_pages & pages)) return;
+
+    // only blocks starting at most one block length before the write can overlap it
+    int from = address - RECOMPILER_MAX_BLOCK * 2;
+    if (from < 0) from = 0;
+
+    for (uint32_t start = from; start < end && start < MEMORY_SIZE; start++) {
+        if (blocks[start].code && blocks[start].end > address)
+            blocks[start] = {};
+    }
+}
+
+void Recompiler::Flush() {
+    memset(blocks, 0, sizeof(blocks));
+    code_pages = 0;
+    arena_used = 0;
+}
+
+// runs a single instruction at `pc` through the interpreter, called from compiled code
+void Recompiler::Step(Chip8 *chip_8, uint32_t pc) {
+    chip_8->pc = pc;
+    chip_8->Fallback(1);
+}
+
+bool Recompiler::Compile(uint16_t start) {
+#if RECOMPILER_X86_64
+    if (!arena) return false;
+    if (arena_used + RECOMPILER_BLOCK_BYTES > RECOMPILER_ARENA_SIZE) Flush();
+    if (mprotect(arena, RECOMPILER_ARENA_SIZE, PROT_READ | PROT_WRITE) != 0) return false;
+
+    auto offset = [this](const void *field) {
+        return int32_t(static_cast<const uint8_t *>(field) - reinterpret_cast<const uint8_t *>(chip_8));
+    };
+    int32_t v = offset(chip_8->V);
+    int32_t vf = v + 0xF;
+    int32_t i_reg = offset(&chip_8->I);
+    int32_t pc_reg = offset(&chip_8->pc);
+    int32_t dt_reg = offset(&chip_8->dt);
+    int32_t st_reg = offset(&chip_8->st);
+    int32_t opcode_reg = offset(&chip_8->opcode);
+    int32_t sp_reg = offset(&chip_8->sp);
+    int32_t stack = offset(chip_8->stack);
+    int32_t keys = offset(&chip_8->keys);
+
+    uint8_t *code = arena + arena_used;
+    Emitter e{code};
+
+    // the Chip8 pointer lives in rbx for the whole block, which also keeps the
+    // stack 16 byte aligned for the calls into Step
+    e.Bytes({0x53, 0x48, 0x89, 0xFB});  // push rbx; mov rbx, rdi
+
+    uint16_t address = start;
+    uint16_t length = 0;
+    uint16_t last_opcode = 0;
+    bool terminated = false;
+
+    while (!terminated && length < RECOMPILER_MAX_BLOCK && address + 1 < MEMORY_SIZE) {
+        const Chip8::Instruction &inst = chip_8->decoded[address >> 1];
+        int32_t vx = v + inst.x;
+        int32_t vy = v + inst.y;
+
+        switch (inst.op) {
+            case Chip8::kLdImm:  // LD Vx, kk
+                e.Mem(0xC6, 0, vx);
+                e.Byte(inst.kk);
+                break;
+            case Chip8::kAddImm:  // ADD Vx, kk
+                e.Mem(0x80, 0, vx);
+                e.Byte(inst.kk);
+                break;
+            case Chip8::kLdReg:  // LD Vx, Vy
+                e.Load8(kAl, vy);
+                e.Store8(vx, kAl);
+                break;
+            case Chip8::kOr:  // OR Vx, Vy
+            case Chip8::kAnd:  // AND Vx, Vy
+            case Chip8::kXor:  // XOR Vx, Vy
+                e.Load8(kAl, vx);
+                e.Mem(inst.op == Chip8::kOr ? 0x0A : inst.op == Chip8::kAnd ? 0x22 : 0x32, kAl, vy);
+                e.Store8(vx, kAl);
+                break;
+            case Chip8::kAddReg:  // ADD Vx, Vy, VF compares the result like the interpreter does
+                e.Load8(kAl, vx);
+                e.Mem(0x02, kAl, vy);
+                e.Store8(vx, kAl);
+                e.Load8(kCl, vy);
+                e.Mem(0x3A, kCl, vx);
+                e.SetFlag(0x97, vf);  // seta
+                break;
+            case Chip8::kSub:  // SUB Vx, Vy
+                e.Load8(kCl, vy);
+                e.Mem(0x3A, kCl, vx);
+                e.SetFlag(0x96, vf);  // setbe
+                e.Load8(kAl, vx);
+                e.Mem(0x2A, kAl, vy);
+                e.Store8(vx, kAl);
+                break;
+            case Chip8::kSubn:  // SUBN Vx, Vy
+                e.Load8(kCl, vy);
+                e.Mem(0x3A, kCl, vx);
+                e.SetFlag(0x93, vf);  // setae
+                e.Load8(kAl, vy);
+                e.Mem(0x2A, kAl, vx);
+                e.Store8(vx, kAl);
+                break;
+            case Chip8::kLdI:  // LD I, nnn
+                e.Store16(i_reg, inst.opcode & 0x0FFF);
+                break;
+            case Chip8::kLdVxDt:  // LD Vx, DT
+                e.Load8(kAl, dt_reg);
+                e.Store8(vx, kAl);
+                break;
+            case Chip8::kLdDtVx:  // LD DT, Vx
+            case Chip8::kLdStVx:  // LD ST, Vx
+                e.Load8(kAl, vx);
+                e.Store8(inst.op == Chip8::kLdDtVx ? dt_reg : st_reg, kAl);
+                break;
+            case Chip8::kAddI:  // ADD I, Vx
+                e.Byte(0x0F);
+                e.Mem(0xB6, kAl, vx);  // movzx eax, byte [Vx]
+                e.Byte(0x0F);
+                e.Mem(0xB7, kCl, i_reg);  // movzx ecx, word [I]
+                e.Bytes({0x01, 0xC1});  // add ecx, eax
+                e.Bytes({0x81, 0xF9});  // cmp ecx, 0xFFF
+                e.Imm32(0xFFF);
+                e.SetFlag(0x97, vf);  // seta
+                e.Byte(0x0F);
+                e.Mem(0xB6, kAl, vx);  // Vx may have been VF
+                e.Byte(0x66);
+                e.Mem(0x01, kAl, i_reg);  // add word [I], ax
+                break;
+            case Chip8::kLdF:  // LD F, Vx
+                e.Byte(0x0F);
+                e.Mem(0xB6, kAl, vx);
+                e.Bytes({0x8D, 0x04, 0x80});  // lea eax, [rax + rax * 4]
+                e.Byte(0x66);
+                e.Mem(0x89, kAl, i_reg);
+                break;
+            case Chip8::kJp:  // JP nnn
+                e.Store16(pc_reg, inst.opcode & 0x0FFF);
+                terminated = true;
+                break;
+            case Chip8::kCall:  // CALL nnn
+                e.Byte(0x0F);
+                e.Mem(0xB6, kAl, sp_reg);  // movzx eax, byte [sp]
+                e.Bytes({0x66, 0xC7, 0x84, 0x43});  // mov word [rbx + rax * 2 + stack], address
+                e.Imm32(stack);
+                e.Imm16(address);
+                e.Mem(0xFE, 0, sp_reg);  // inc byte [sp]
+                e.Store16(pc_reg, inst.opcode & 0x0FFF);
+                terminated = true;
+                break;
+            case Chip8::kRet:  // RET
+                e.Mem(0xFE, 1, sp_reg);  // dec byte [sp]
+                e.Byte(0x0F);
+                e.Mem(0xB6, kAl, sp_reg);
+                e.Bytes({0x0F, 0xB7, 0x84, 0x43});  // movzx eax, word [rbx + rax * 2 + stack]
+                e.Imm32(stack);
+                e.Bytes({0x83, 0xC0, 0x02});  // add eax, 2
+                e.Byte(0x66);
+                e.Mem(0x89, kAl, pc_reg);
+                terminated = true;
+                break;
+            case Chip8::kSeImm:  // SE Vx, kk
+            case Chip8::kSneImm:  // SNE Vx, kk
+                e.Mem(0x80, 7, vx);  // cmp byte [Vx], kk
+                e.Byte(inst.kk);
+                e.Skip(inst.op == Chip8::kSeImm ? 0x44 : 0x45, pc_reg, address);  // cmove / cmovne
+                terminated = true;
+                break;
+            case Chip8::kSeReg:  // SE Vx, Vy
+            case Chip8::kSneReg:  // SNE Vx, Vy
+                e.Load8(kAl, vx);
+                e.Mem(0x3A, kAl, vy);
+                e.Skip(inst.op == Chip8::kSeReg ? 0x44 : 0x45, pc_reg, address);
+                terminated = true;
+                break;
+            case Chip8::kSkp:  // SKP Vx
+            case Chip8::kSknp:  // SKNP Vx
+                e.Byte(0x0F);
+                e.Mem(0xB6, kCl, vx);  // movzx ecx, byte [Vx]
+                e.Bytes({0x83, 0xE1, 0x0F});  // and ecx, 0xF
+                e.Byte(0x0F);
+                e.Mem(0xB7, kAl, keys);  // movzx eax, word [keys]
+                e.Bytes({0x0F, 0xA3, 0xC8});  // bt eax, ecx
+                e.Skip(inst.op == Chip8::kSkp ? 0x42 : 0x43, pc_reg, address);  // cmovc / cmovnc
+                terminated = true;
+                break;
+            case Chip8::kDrw:
+            case Chip8::kLdVxK:
+            case Chip8::kJpV0:
+            case Chip8::kLdB:
+            case Chip8::kLdStore:
+            case Chip8::kExit:
+                terminated = true;
+                // fall through
+            default:
+                e.Bytes({0x48, 0x89, 0xDF});  // mov rdi, rbx
+                e.Byte(0xBE);  // mov esi, address
+                e.Imm32(address);
+                e.Bytes({0x48, 0xB8});  // mov rax, Step
+                e.Imm64(reinterpret_cast<uint64_t>(&Recompiler::Step));
+                e.Bytes({0xFF, 0xD0});  // call rax
+        }
+
+        last_opcode = inst.opcode;
+        address += 2;
+        length++;
+    }
+
+    // terminators leave pc to the interpreter, blocks cut short continue in order
+    if (!terminated)
+        e.Store16(pc_reg, address);
+    e.Store16(opcode_reg, last_opcode);
+    e.Bytes({0x5B, 0xC3});  // pop rbx; ret
+
+    arena_used += e.out - code;
+
+    // the blocks compiled so far can not run without this, the interpreter takes over
+    if (mprotect(arena, RECOMPILER_ARENA_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        Flush();
+        munmap(arena, RECOMPILER_ARENA_SIZE);
+        arena = nullptr;
+        return false;
+    }
+
+    blocks[start].code = reinterpret_cast<BlockCode>(code);
+    blocks[start].end = address;
+    blocks[start].length = length;
+
+    for (int page = start >> 8; page <= (address - 1) >> 8; page++)
+        code_pages |= 1 << page;
+
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,48 @@
+#ifndef CHIP8LER__RECOMPILER_HPP_
+#define CHIP8LER__RECOMPILER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Chip8.hpp"
+
+#define RECOMPILER_ARENA_SIZE (1 << 20)
+#define RECOMPILER_MAX_BLOCK 64  // instructions per block
+
+// Translates basic blocks of CHIP-8 code into x86-64 and runs them in place of the
+// interpreter. A block runs until the first instruction that can change the program
+// counter or the screen (JP, CALL, RET, skips, DRW, Fx0A) or write memory (Fx33, Fx55).
+// Instructions without a native translation are handed back to the interpreter.
+class Recompiler {
+ public:
+    explicit Recompiler(Chip8 *chip_8);
+    ~Recompiler();
+
+    static bool IsSupported();
+
+    uint32_t Execute(uint32_t cycles);
+    void Invalidate(uint16_t address, uint16_t length);
+
+ private:
+    typedef void (*BlockCode)(Chip8 *chip_8);
+
+    struct Block {
+        BlockCode code;
+        uint16_t end;       // first address past the block
+        uint16_t length;    // instructions, including the terminator
+    };
+
+    Chip8 *chip_8;
+    Block blocks[MEMORY_SIZE] = {};  // indexed by start address
+    uint16_t code_pages;  // each bit is a 256 byte page holding compiled code
+
+    uint8_t *arena;
+    size_t arena_used;
+
+    bool Compile(uint16_t start);
+    void Flush();
+
+    static void Step(Chip8 *chip_8, uint32_t pc);
+};
+
+#endif //CHIP8LER__RECOMPILER_HPP_
@@ -0,0 +1,143 @@
+#include <cstring>
+
+#include "Rewind.hpp"
+
+// a literal run only ends at this many zero bytes in a row, shorter gaps cost more as a
+// new run header than they save
+#define MIN_ZERO_RUN 4
+
+// the newest group, and the end of the ring a wrap leaves unused, always fit with room to
+// spare, so storing never evicts the keyframe the deltas after it are taken against
+static_assert((REWIND_KEYFRAME_INTERVAL + 1) * sizeof(Chip8State) < REWIND_BUFFER_SIZE,
+              "the rewind ring must hold a whole keyframe group");
+
+RewindBuffer::RewindBuffer() : ring(REWIND_BUFFER_SIZE) {
+    Clear();
+}
+
+void RewindBuffer::Clear() {
+    entries.clear();
+    head = 0;
+    bytes_used = 0;
+    since_keyframe = REWIND_KEYFRAME_INTERVAL;  // the next state is always a keyframe
+}
+
+size_t RewindBuffer::Frames() const {
+    return entries.size();
+}
+
+size_t RewindBuffer::BytesUsed() const {
+    return bytes_used;
+}
+
+void RewindBuffer::Push(const Chip8State &state) {
+    if (since_keyframe < REWIND_KEYFRAME_INTERVAL) {
+        EncodeDelta(state);
+
+        // a delta that would not be smaller than the state itself is pointless
+        if (scratch.size() < sizeof(Chip8State)) {
+            Store(scratch.data(), scratch.size(), false);
+            since_keyframe++;
+            return;
+        }
+    }
+
+    keyframe = state;
+    since_keyframe = 1;
+    Store(reinterpret_cast<const uint8_t *>(&keyframe), sizeof(Chip8State), true);
+}
+
+bool RewindBuffer::Pop(Chip8State &state) {
+    if (entries.empty()) return false;
+
+    // find the keyframe of the newest state's group
+    size_t index = entries.size() - 1;
+    while (!entries[index].keyframe) index--;
+
+    const Entry &base = entries[index];
+    memcpy(&state, &ring[base.offset], sizeof(Chip8State));
+
+    const Entry &newest = entries.back();
+    if (!newest.keyframe) {
+        uint8_t *bytes = reinterpret_cast<uint8_t *>(&state);
+        const uint8_t *data = &ring[newest.offset];
+        const uint8_t *end = data + newest.length;
+        size_t position = 0;
+
+        while (data < end) {
+            uint16_t zeroes, literals;
+            memcpy(&zeroes, data, sizeof(zeroes));
+            memcpy(&literals, data + 2, sizeof(literals));
+            data += 4;
+
+            position += zeroes;
+            for (int i = 0; i < literals; i++)
+                bytes[position++] ^= *data++;
+        }
+    }
+
+    bytes_used -= newest.length;
+    head = newest.offset;
+    entries.pop_back();
+
+    // the cached keyframe may be gone now, start a new group with whatever comes next
+    since_keyframe = REWIND_KEYFRAME_INTERVAL;
+    return true;
+}
+
+void RewindBuffer::EncodeDelta(const Chip8State &state) {
+    const uint8_t *a = reinterpret_cast<const uint8_t *>(&state);
+    const uint8_t *b = reinterpret_cast<const uint8_t *>(&keyframe);
+    size_t size = sizeof(Chip8State);
+
+    scratch.clear();
+    size_t i = 0;
+    while (i < size) {
+        uint16_t zeroes = 0;
+        while (i < size && a[i] == b[i] && zeroes < UINT16_MAX) {
+            zeroes++;
+            i++;
+        }
+        if (i == size) break;
+
+        size_t header = scratch.size();
+        scratch.resize(header + 4);
+
+        uint16_t literals = 0;
+        while (i < size && literals < UINT16_MAX) {
+            if (i + MIN_ZERO_RUN <= size && memcmp(a + i, b + i, MIN_ZERO_RUN) == 0) break;
+            scratch.push_back(a[i] ^ b[i]);
+            literals++;
+            i++;
+        }
+
+        memcpy(&scratch[header], &zeroes, sizeof(zeroes));
+        memcpy(&scratch[header + 2], &literals, sizeof(literals));
+    }
+}
+
+void RewindBuffer::Store(const uint8_t *data, uint32_t length, bool is_keyframe) {
+    if (head + length > ring.size()) {
+        // the rest of the ring is too small, drop what is left of the previous lap and
+        // start again from the beginning
+        while (!entries.empty() && entries.front().offset >= head) EvictOldest();
+        head = 0;
+    }
+
+    // entries from the previous lap that are in the way
+    while (!entries.empty() && entries.front().offset >= head && entries.front().offset < head + length)
+        EvictOldest();
+
+    memcpy(&ring[head], data, length);
+    entries.push_back({head, length, is_keyframe});
+    head += length;
+    bytes_used += length;
+}
+
+void RewindBuffer::EvictOldest() {
+    // deltas can not be restored without their keyframe, so they go together
+    do {
+        bytes_used -= entries.front().length;
+        entries.pop_front();
+    } while (!entries.empty() && !entries.front().keyframe);
+}
@@ -0,0 +1,51 @@
+#ifndef CHIP8LER__REWIND_HPP_
+#define CHIP8LER__REWIND_HPP_
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "Chip8.hpp"
+
+#define REWIND_BUFFER_SIZE (4 << 20)  // bytes of history, several minutes at one state per frame
+#define REWIND_KEYFRAME_INTERVAL 60   // states between full copies
+
+// History of machine states, newest last. Every REWIND_KEYFRAME_INTERVAL states a full
+// copy is stored, the ones in between are stored as the XOR against that keyframe with
+// runs of zeroes left out. The storage is a fixed ring, when it is full the oldest
+// keyframe is dropped together with every delta that depends on it.
+class RewindBuffer {
+ public:
+    RewindBuffer();
+
+    void Push(const Chip8State &state);
+
+    // removes the newest state and copies it into `state`, false when there is no history left
+    bool Pop(Chip8State &state);
+
+    void Clear();
+    size_t Frames() const;
+    size_t BytesUsed() const;
+
+ private:
+    struct Entry {
+        uint32_t offset;  // into ring
+        uint32_t length;
+        bool keyframe;
+    };
+
+    std::vector<uint8_t> ring;
+    std::deque<Entry> entries;
+    uint32_t head;  // where the next entry goes
+    size_t bytes_used;
+
+    Chip8State keyframe;  // copy of the newest keyframe, deltas are taken against it
+    uint32_t since_keyframe;
+    std::vector<uint8_t> scratch;
+
+    void EncodeDelta(const Chip8State &state);
+    void Store(const uint8_t *data, uint32_t length, bool is_keyframe);
+    void EvictOldest();
+};
+
+#endif //CHIP8LER__REWIND_HPP_
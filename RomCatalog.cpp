@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "Chip8.hpp"
+#include "Hash.hpp"
+#include "RomCatalog.hpp"
+
+namespace {
+
+// one rom as found on disk, before it is laid out in the index
+struct Scanned {
+    uint64_t hash;
+    std::vector<uint8_t> rom;
+    std::string path, category, title, author, year, description;
+};
+
+std::string Trim(const std::string &text) {
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) return "";
+    return text.substr(first, text.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+// "Title [Author, Year] (alt)", the brackets and what is in them are optional
+void ParseName(const std::string &stem, Scanned &scanned) {
+    size_t open = stem.find(" [");
+    size_t close = stem.find(']', open);
+    if (open == std::string::npos || close == std::string::npos) {
+        scanned.title = Trim(stem);
+        return;
+    }
+
+    scanned.title = Trim(stem.substr(0, open) + stem.substr(close + 1));
+
+    std::string credit = stem.substr(open + 2, close - open - 2);
+    size_t comma = credit.rfind(", ");
+    std::string last = comma == std::string::npos ? "" : credit.substr(comma + 2);
+    bool dated = last.size() == 4 && isdigit(last[0]) && isdigit(last[1]);  // 1977, 199x...
+    if (dated) {
+        scanned.author = Trim(credit.substr(0, comma));
+        scanned.year = last;
+    } else {
+        scanned.author = Trim(credit);
+    }
+}
+
+std::string ReadText(const std::filesystem::path &path) {
+    MappedFile file;
+    if (!file.Open(path.string())) return "";
+
+    std::string text(reinterpret_cast<const char *>(file.Data()), file.Size());
+    text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+    return Trim(text);
+}
+
+}
+
+bool RomCatalog::Open(const std::string &directory, bool rescan) {
+    std::string path = directory + "/" + CATALOG_FILE;
+    if (!rescan && Load(path)) return true;
+
+    if (!Build(directory, path)) return false;
+    return Load(path);
+}
+
+const std::vector<RomInfo> &RomCatalog::Roms() const {
+    return roms;
+}
+
+const RomInfo *RomCatalog::Find(uint64_t hash) const {
+    auto found = std::lower_bound(roms.begin(), roms.end(), hash,
+                                  [](const RomInfo &rom, uint64_t value) { return rom.hash < value; });
+    return found != roms.end() && found->hash == hash ? &*found : nullptr;
+}
+
+bool RomCatalog::Load(const std::string &path) {
+    roms.clear();
+    if (!file.Open(path)) return false;
+
+    CatalogHeader header;
+    if (file.Size() < sizeof(header)) return false;
+    memcpy(&header, file.Data(), sizeof(header));
+    if (header.magic != CATALOG_MAGIC || header.version != CATALOG_VERSION || header.record_size != sizeof(CatalogRecord))
+        return false;
+    if (file.Size() < sizeof(header) + uint64_t(header.count) * sizeof(CatalogRecord)) return false;
+
+    auto fits = [this](uint32_t offset, uint32_t length) { return uint64_t(offset) + length <= file.Size(); };
+    auto text = [this](CatalogString string) {
+        return std::string(reinterpret_cast<const char *>(file.Data()) + string.offset, string.length);
+    };
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        // copied out, the table is only byte aligned in the mapping
+        CatalogRecord record;
+        memcpy(&record, file.Data() + sizeof(header) + i * sizeof(record), sizeof(record));
+
+        bool valid = fits(record.rom_offset, record.rom_size) && record.rom_size <= MAX_ROM_SIZE;
+        for (CatalogString string : {record.path, record.category, record.title, record.author, record.year, record.description})
+            valid = valid && fits(string.offset, string.length);
+        if (!valid) {
+            std::cerr << "Failed to load rom catalog, corrupt entry: " << path << std::endl;
+            roms.clear();
+            return false;
+        }
+
+        roms.push_back({record.hash, text(record.path), text(record.category), text(record.title), text(record.author),
+                        text(record.year), text(record.description), file.Data() + record.rom_offset, record.rom_size});
+    }
+
+    return true;
+}
+
+bool RomCatalog::Build(const std::string &directory, const std::string &path) {
+    namespace fs = std::filesystem;
+
+    std::vector<Scanned> found;
+    std::error_code error;
+    for (fs::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        if (!it->is_regular_file() || it->path().extension() != ".ch8") continue;
+
+        MappedFile rom;
+        if (!rom.Open(it->path().string())) {
+            std::cerr << "Failed to read rom, skipping: " << it->path().string() << std::endl;
+            continue;
+        }
+        if (rom.Size() > MAX_ROM_SIZE) {
+            std::cerr << "Rom is larger than " << MAX_ROM_SIZE << " bytes, skipping: " << it->path().string() << std::endl;
+            continue;
+        }
+
+        Scanned scanned;
+        scanned.hash = Fnv1a(rom.Data(), rom.Size());
+        scanned.rom.assign(rom.Data(), rom.Data() + rom.Size());
+        fs::path relative = it->path().lexically_relative(directory);
+        scanned.path = relative.generic_string();
+        scanned.category = relative.has_parent_path() ? relative.begin()->string() : "";
+        ParseName(it->path().stem().string(), scanned);
+
+        fs::path companion = it->path();
+        scanned.description = ReadText(companion.replace_extension(".txt"));
+        found.push_back(std::move(scanned));
+    }
+
+    if (error) {
+        std::cerr << "Failed to scan roms: " << directory << " (" << error.message() << ")" << std::endl;
+        return false;
+    }
+
+    // by hash for lookups, by path among identical roms so every scan writes the same file
+    std::sort(found.begin(), found.end(), [](const Scanned &a, const Scanned &b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.path < b.path;
+    });
+
+    CatalogHeader header = {CATALOG_MAGIC, CATALOG_VERSION, sizeof(CatalogRecord), uint32_t(found.size()), 0};
+    std::vector<CatalogRecord> records;
+    std::vector<uint8_t> blob;
+    uint32_t base = sizeof(header) + found.size() * sizeof(CatalogRecord);
+
+    auto append = [&](const void *data, size_t length) {
+        auto bytes = static_cast<const uint8_t *>(data);
+        CatalogString string = {uint32_t(base + blob.size()), uint32_t(length)};
+        blob.insert(blob.end(), bytes, bytes + length);
+        return string;
+    };
+
+    for (const Scanned &scanned : found) {
+        CatalogRecord record = {};
+        record.hash = scanned.hash;
+        CatalogString rom = append(scanned.rom.data(), scanned.rom.size());
+        record.rom_offset = rom.offset;
+        record.rom_size = rom.length;
+        record.path = append(scanned.path.data(), scanned.path.size());
+        record.category = append(scanned.category.data(), scanned.category.size());
+        record.title = append(scanned.title.data(), scanned.title.size());
+        record.author = append(scanned.author.data(), scanned.author.size());
+        record.year = append(scanned.year.data(), scanned.year.size());
+        record.description = append(scanned.description.data(), scanned.description.size());
+        records.push_back(record);
+    }
+
+    // written next to the old index and renamed over it, a catalog that is still mapped
+    // somewhere keeps its contents
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Failed to write rom catalog: " << path << std::endl;
+            return false;
+        }
+
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(CatalogRecord));
+        out.write(reinterpret_cast<const char *>(blob.data()), blob.size());
+        if (!out.good()) {
+            std::cerr << "Failed to write rom catalog: " << path << std::endl;
+            return false;
+        }
+    }
+
+    fs::rename(temporary, path, error);
+    if (error) {
+        std::cerr << "Failed to write rom catalog: " << path << " (" << error.message() << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef CHIP8LER__ROMCATALOG_HPP_
+#define CHIP8LER__ROMCATALOG_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+#define CATALOG_MAGIC 0x43523843  // "C8RC"
+#define CATALOG_VERSION 1
+#define CATALOG_FILE "catalog.idx"  // kept in the directory it indexes
+#define CATALOG_DEFAULT_DIRECTORY "roms"
+
+// where a string is in the index file
+struct CatalogString {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// fixed size part of an entry. Rom bytes and strings follow the whole table
+struct CatalogRecord {
+    uint64_t hash;  // FNV-1a of the rom, see Hash.hpp
+    uint32_t rom_offset;
+    uint32_t rom_size;
+    CatalogString path;
+    CatalogString category;
+    CatalogString title;
+    CatalogString author;
+    CatalogString year;
+    CatalogString description;
+};
+
+static_assert(sizeof(CatalogRecord) == 64, "catalog records are written to disk as is");
+
+struct CatalogHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t count;  // records, sorted by hash
+    uint32_t reserved;
+};
+
+struct RomInfo {
+    uint64_t hash;
+    std::string path;      // relative to the catalog directory
+    std::string category;  // first directory under it: games, demos...
+    std::string title;     // file names read "Title [Author, Year] (alt)"
+    std::string author;
+    std::string year;
+    std::string description;  // the companion .txt, empty without one
+    const uint8_t *data;   // the rom itself, inside the index, ready for Chip8::LoadRom
+    uint32_t size;
+};
+
+// Every rom under a directory, scanned once into an index file next to them. The index
+// carries the roms themselves, so opening it is one mapping and looking a rom up by hash
+// is a binary search, no rom file is opened or read again until the next rescan.
+class RomCatalog {
+ public:
+    RomCatalog() = default;
+    RomCatalog(const RomCatalog &) = delete;
+    RomCatalog &operator=(const RomCatalog &) = delete;
+
+    // maps `directory`/CATALOG_FILE, scanning the directory and writing it first when it
+    // is missing, unreadable or `rescan` is set
+    bool Open(const std::string &directory, bool rescan = false);
+
+    // sorted by hash. Pointers stay valid until the catalog is opened again or destroyed
+    const std::vector<RomInfo> &Roms() const;
+    const RomInfo *Find(uint64_t hash) const;
+
+ private:
+    MappedFile file;
+    std::vector<RomInfo> roms;
+
+    bool Load(const std::string &path);
+    static bool Build(const std::string &directory, const std::string &path);
+};
+
+#endif //CHIP8LER__ROMCATALOG_HPP_
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <thread>
+
+#include "Movie.hpp"
+#include "Scheduler.hpp"
+
+Scheduler::Scheduler(Chip8 *chip_8) {
+    this->chip_8 = chip_8;
+    recorder = nullptr;
+    frame_period = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / TIMER_FREQUENCY;
+
+    window_instructions = 0;
+    window_frames = 0;
+    window_jitter_ms = 0;
+    window_max_jitter_ms = 0;
+
+    SetMode(SchedulerMode::kAccurate);
+}
+
+void Scheduler::SetMode(SchedulerMode mode, uint32_t instructions_per_second) {
+    this->mode = mode;
+
+    // turbo keeps the speed the timers were last running at, so a game runs the same
+    // number of instructions between timer ticks as it did before
+    chip_8->SetTimerMode(TimerMode::kVirtual);
+    if (mode != SchedulerMode::kTurbo)
+        chip_8->SetClockSpeed(instructions_per_second);
+
+    deadline = Clock::now();
+    window_start = deadline;
+}
+
+SchedulerMode Scheduler::GetMode() const {
+    return mode;
+}
+
+void Scheduler::SetRecorder(MovieRecorder *recorder) {
+    this->recorder = recorder;
+}
+
+bool Scheduler::RunFrame() {
+    auto start = Clock::now();
+    double jitter = std::chrono::duration<double, std::milli>(start - deadline).count();
+    window_jitter_ms += std::max(jitter, 0.0);
+    window_max_jitter_ms = std::max(window_max_jitter_ms, jitter);
+    window_frames++;
+
+    if (mode != SchedulerMode::kTurbo) {
+        window_instructions += chip_8->RunFrame();
+        if (recorder) recorder->Frame(*chip_8);
+        return chip_8->ShouldUpdateDisplay();
+    }
+
+    // emulated frames back to back until this host frame's time is used up,
+    // only looking at the clock every few frames since they are so short
+    bool updated = false;
+    auto end = deadline + frame_period;
+    do {
+        for (int i = 0; i < TURBO_FRAMES_PER_CHECK; i++) {
+            window_instructions += chip_8->RunFrame();
+            if (recorder) recorder->Frame(*chip_8);
+            updated |= chip_8->ShouldUpdateDisplay();
+        }
+    } while (Clock::now() < end);
+
+    return updated;
+}
+
+void Scheduler::WaitForNextFrame() {
+    deadline += frame_period;
+
+    auto now = Clock::now();
+    if (now - deadline > frame_period * MAX_FRAMES_BEHIND) {
+        // too far behind to catch up, start a fresh schedule
+        deadline = now;
+        return;
+    }
+
+    if (mode != SchedulerMode::kTurbo)
+        std::this_thread::sleep_until(deadline);
+}
+
+bool Scheduler::PollStats(SchedulerStats &stats) {
+    auto now = Clock::now();
+    double seconds = std::chrono::duration<double>(now - window_start).count();
+    if (seconds < 1.0 || !window_frames) return false;
+
+    stats.instructions_per_second = window_instructions / seconds;
+    stats.frames_per_second = window_frames / seconds;
+    stats.mean_jitter_ms = window_jitter_ms / window_frames;
+    stats.max_jitter_ms = window_max_jitter_ms;
+
+    window_start = now;
+    window_instructions = 0;
+    window_frames = 0;
+    window_jitter_ms = 0;
+    window_max_jitter_ms = 0;
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef CHIP8LER__SCHEDULER_HPP_
+#define CHIP8LER__SCHEDULER_HPP_
+
+#include <chrono>
+#include <cstdint>
+
+#include "Chip8.hpp"
+
+class MovieRecorder;
+
+#define CHIP8_CLOCK_SPEED 500       // instructions per second on a COSMAC VIP
+#define SUPERCHIP_CLOCK_SPEED 1000
+#define MAX_FRAMES_BEHIND 6         // frames of lag before the schedule is reset instead of caught up
+#define TURBO_FRAMES_PER_CHECK 16   // emulated frames between clock reads in turbo mode
+
+enum class SchedulerMode {
+    kAccurate,  // CHIP-8 or SuperCHIP speed
+    kCustom,    // any instructions per second
+    kTurbo,     // as fast as possible, presenting once per host frame
+};
+
+struct SchedulerStats {
+    double instructions_per_second;
+    double frames_per_second;
+    double mean_jitter_ms;  // how late frames started compared to their deadline
+    double max_jitter_ms;
+};
+
+// Paces a Chip8 in 60 Hz frames. Each frame runs a whole frame's worth of instructions
+// in one batch and then sleeps once until the next deadline. Deadlines advance by a
+// fixed period on the monotonic clock, so oversleeping one frame shortens the next.
+class Scheduler {
+ public:
+    explicit Scheduler(Chip8 *chip_8);
+
+    void SetMode(SchedulerMode mode, uint32_t instructions_per_second = CHIP8_CLOCK_SPEED);
+    SchedulerMode GetMode() const;
+
+    // every emulated frame is handed to `recorder` once it ran, nullptr stops that
+    void SetRecorder(MovieRecorder *recorder);
+
+    // runs one host frame, returns true if the display changed
+    bool RunFrame();
+    void WaitForNextFrame();
+
+    // true about once a second, with the stats for the window since the last report
+    bool PollStats(SchedulerStats &stats);
+
+ private:
+    using Clock = std::chrono::steady_clock;
+
+    Chip8 *chip_8;
+    SchedulerMode mode;
+    MovieRecorder *recorder;
+
+    Clock::duration frame_period;
+    Clock::time_point deadline;
+
+    Clock::time_point window_start;
+    uint64_t window_instructions;
+    uint32_t window_frames;
+    double window_jitter_ms;
+    double window_max_jitter_ms;
+};
+
+#endif //CHIP8LER__SCHEDULER_HPP_
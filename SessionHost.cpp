@@ -0,0 +1,208 @@
+#include <algorithm>
+
+#include "SessionHost.hpp"
+
+SessionHost::SessionHost(unsigned threads) : running(false), next_id(1) {
+    period = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / TIMER_FREQUENCY;
+
+    if (!threads) threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned i = 0; i < threads; i++)
+        workers.push_back(std::make_unique<Worker>());
+}
+
+SessionHost::~SessionHost() {
+    Stop();
+}
+
+void SessionHost::Start() {
+    if (running.exchange(true)) return;
+
+    // sessions opened or left over while stopped start on a fresh schedule
+    auto first = Clock::now() + period;
+    for (auto &worker : workers) {
+        for (Job &job : worker->jobs)
+            job.deadline = first;
+    }
+
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i]->thread = std::thread(&SessionHost::Run, this, i);
+}
+
+void SessionHost::Stop() {
+    if (!running.exchange(false)) return;
+
+    for (auto &worker : workers)
+        worker->thread.join();
+}
+
+uint32_t SessionHost::Open(const uint8_t *rom, size_t size, uint32_t instructions_per_second) {
+    auto session = std::make_shared<Session>();
+    if (!session->chip_8.LoadRom(rom, size)) return 0;
+    session->chip_8.SetTimerMode(TimerMode::kVirtual);
+    session->chip_8.SetClockSpeed(instructions_per_second);
+
+    uint32_t id;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        id = next_id++;
+        sessions[id] = session;
+    }
+
+    // the first frame is due a period from now, on the worker with the fewest sessions
+    Worker *least = nullptr;
+    size_t least_jobs = SIZE_MAX;
+    for (auto &worker : workers) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (worker->jobs.size() < least_jobs) {
+            least = worker.get();
+            least_jobs = worker->jobs.size();
+        }
+    }
+    Push(*least, {Clock::now() + period, session});
+    return id;
+}
+
+void SessionHost::Close(uint32_t session) {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    auto found = sessions.find(session);
+    if (found == sessions.end()) return;
+
+    // the frame job in flight drops the session when it next comes up
+    found->second->open.store(false, std::memory_order_relaxed);
+    sessions.erase(found);
+}
+
+size_t SessionHost::Sessions() const {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    return sessions.size();
+}
+
+bool SessionHost::SetKey(uint32_t session, uint8_t key, bool pressed) {
+    std::shared_ptr<Session> found = Find(session);
+    if (!found) return false;
+
+    found->chip_8.SetKey(key, pressed);
+    return true;
+}
+
+const Frame *SessionHost::TakeFrame(uint32_t session) {
+    std::shared_ptr<Session> found = Find(session);
+    if (!found || !found->frames.Acquire()) return nullptr;
+    return &found->frames.Front();
+}
+
+bool SessionHost::GetStats(uint32_t session, SessionStats &stats) const {
+    std::shared_ptr<Session> found = Find(session);
+    if (!found) return false;
+
+    stats.frames = found->frames_run.load(std::memory_order_relaxed);
+    stats.deadline_misses = found->deadline_misses.load(std::memory_order_relaxed);
+    stats.cpu_ns = found->cpu_ns.load(std::memory_order_relaxed);
+    stats.max_late_ns = found->max_late_ns.load(std::memory_order_relaxed);
+    stats.steals = found->steals.load(std::memory_order_relaxed);
+    return true;
+}
+
+std::shared_ptr<SessionHost::Session> SessionHost::Find(uint32_t session) const {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    auto found = sessions.find(session);
+    return found == sessions.end() ? nullptr : found->second;
+}
+
+void SessionHost::Push(Worker &worker, Job job) {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.jobs.push_back(std::move(job));
+    std::push_heap(worker.jobs.begin(), worker.jobs.end(),
+                   [](const Job &a, const Job &b) { return a.deadline > b.deadline; });
+}
+
+bool SessionHost::PopReady(Worker &worker, Clock::time_point now, Job &job) {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.jobs.empty() || worker.jobs.front().deadline - period > now) return false;
+
+    std::pop_heap(worker.jobs.begin(), worker.jobs.end(),
+                  [](const Job &a, const Job &b) { return a.deadline > b.deadline; });
+    job = std::move(worker.jobs.back());
+    worker.jobs.pop_back();
+    return true;
+}
+
+bool SessionHost::Steal(size_t thief, Clock::time_point now, Job &job) {
+    // the victim is whoever has the released job closest to its deadline
+    Worker *victim = nullptr;
+    Clock::time_point most_urgent = Clock::time_point::max();
+    for (size_t i = 0; i < workers.size(); i++) {
+        if (i == thief) continue;
+
+        Worker &worker = *workers[i];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.jobs.empty()) continue;
+
+        Clock::time_point deadline = worker.jobs.front().deadline;
+        if (deadline - period <= now && deadline < most_urgent) {
+            victim = &worker;
+            most_urgent = deadline;
+        }
+    }
+
+    // the victim may have run it in the meantime, then its next job is taken if released
+    return victim && PopReady(*victim, now, job);
+}
+
+void SessionHost::Run(size_t index) {
+    Worker &self = *workers[index];
+
+    while (running.load(std::memory_order_relaxed)) {
+        auto now = Clock::now();
+        Job job;
+        if (PopReady(self, now, job)) {
+            RunFrame(index, job, false);
+            continue;
+        }
+        if (Steal(index, now, job)) {
+            RunFrame(index, job, true);
+            continue;
+        }
+
+        // nothing released anywhere, sleep until the next own job or the next look around
+        auto wake = now + std::chrono::microseconds(HOST_IDLE_POLL_US);
+        {
+            std::lock_guard<std::mutex> lock(self.mutex);
+            if (!self.jobs.empty()) wake = std::min(wake, self.jobs.front().deadline - period);
+        }
+        std::this_thread::sleep_until(wake);
+    }
+}
+
+void SessionHost::RunFrame(size_t index, Job &job, bool stolen) {
+    Session &session = *job.session;
+    if (!session.open.load(std::memory_order_relaxed)) return;  // closed, dropping the job frees it
+
+    auto start = Clock::now();
+    session.chip_8.RunFrame();
+    if (session.chip_8.ShouldUpdateDisplay()) {
+        Frame &frame = session.frames.Back();
+        session.chip_8.GetFrame(frame);
+        frame.number = ++session.frame_number;
+        session.frames.Publish();
+    }
+    auto end = Clock::now();
+
+    // only the worker holding the job writes these, the atomics are for GetStats
+    session.frames_run.fetch_add(1, std::memory_order_relaxed);
+    session.cpu_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+                             std::memory_order_relaxed);
+    if (stolen) session.steals.fetch_add(1, std::memory_order_relaxed);
+    if (end > job.deadline) {
+        uint64_t late = std::chrono::duration_cast<std::chrono::nanoseconds>(end - job.deadline).count();
+        session.deadline_misses.fetch_add(1, std::memory_order_relaxed);
+        if (late > session.max_late_ns.load(std::memory_order_relaxed))
+            session.max_late_ns.store(late, std::memory_order_relaxed);
+    }
+
+    // frames run late are caught up, unless so far behind that a fresh schedule is better
+    job.deadline += period;
+    if (end - job.deadline > period * HOST_MAX_FRAMES_BEHIND)
+        job.deadline = end + period;
+    Push(*workers[index], std::move(job));
+}
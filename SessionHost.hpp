@@ -0,0 +1,100 @@
+#ifndef CHIP8LER__SESSIONHOST_HPP_
+#define CHIP8LER__SESSIONHOST_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Chip8.hpp"
+#include "TripleBuffer.hpp"
+
+#define HOST_IDLE_POLL_US 500     // longest an idle worker sleeps before looking for work to steal
+#define HOST_MAX_FRAMES_BEHIND 6  // frames of lag before a session's schedule is reset instead of caught up
+
+struct SessionStats {
+    uint64_t frames;
+    uint64_t deadline_misses;  // frames that finished after their 60 Hz deadline
+    uint64_t cpu_ns;           // spent running the session's frames
+    uint64_t max_late_ns;      // worst finish past a deadline
+    uint64_t steals;           // frames run by a worker that took them from another one
+};
+
+// Hosts many interactive machines in one process. Every session has one frame job in
+// flight: released at the start of its 60 Hz period, it runs a frame's instructions,
+// publishes the screen if it changed and goes back in line for the next period. Each
+// worker keeps its jobs ordered by deadline and runs the most urgent released one first,
+// workers that run dry steal the most urgent released job from the others.
+class SessionHost {
+ public:
+    using Clock = std::chrono::steady_clock;
+
+    // one worker per core by default
+    explicit SessionHost(unsigned threads = 0);
+    ~SessionHost();
+
+    SessionHost(const SessionHost &) = delete;
+    SessionHost &operator=(const SessionHost &) = delete;
+
+    void Start();
+    void Stop();
+
+    // 0 if the rom does not load. Sessions start running right away when the host is
+    uint32_t Open(const uint8_t *rom, size_t size, uint32_t instructions_per_second = DEFAULT_CLOCK_SPEED);
+    void Close(uint32_t session);
+    size_t Sessions() const;
+
+    // safe from any thread, picked up at the session's next frame
+    bool SetKey(uint32_t session, uint8_t key, bool pressed);
+    // one consumer per session. The newest frame, or nullptr when nothing changed since
+    // the last call. Valid until the next call or Close
+    const Frame *TakeFrame(uint32_t session);
+    bool GetStats(uint32_t session, SessionStats &stats) const;
+
+ private:
+    struct Session {
+        Chip8 chip_8;
+        TripleBuffer<Frame> frames;
+        uint64_t frame_number = 0;
+        std::atomic<bool> open{true};
+
+        std::atomic<uint64_t> frames_run{0};
+        std::atomic<uint64_t> deadline_misses{0};
+        std::atomic<uint64_t> cpu_ns{0};
+        std::atomic<uint64_t> max_late_ns{0};
+        std::atomic<uint64_t> steals{0};
+    };
+
+    struct Job {
+        Clock::time_point deadline;  // released one period before
+        std::shared_ptr<Session> session;
+    };
+
+    // jobs kept as a heap with the earliest deadline on top
+    struct Worker {
+        std::mutex mutex;
+        std::vector<Job> jobs;
+        std::thread thread;
+    };
+
+    Clock::duration period;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> running;
+
+    mutable std::mutex sessions_mutex;
+    std::unordered_map<uint32_t, std::shared_ptr<Session>> sessions;
+    uint32_t next_id;
+
+    std::shared_ptr<Session> Find(uint32_t session) const;
+    void Push(Worker &worker, Job job);
+    bool PopReady(Worker &worker, Clock::time_point now, Job &job);
+    bool Steal(size_t thief, Clock::time_point now, Job &job);
+    void Run(size_t index);
+    void RunFrame(size_t index, Job &job, bool stolen);
+};
+
+#endif //CHIP8LER__SESSIONHOST_HPP_
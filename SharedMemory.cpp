@@ -0,0 +1,230 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "SharedMemory.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define CHIP8LER_SHM 1
+#else
+#define CHIP8LER_SHM 0
+#endif
+
+static SharedSegment *map_segment(const std::string &name, bool create) {
+#if CHIP8LER_SHM
+    // a fresh segment if there is none yet, otherwise the one already there so the
+    // writer can see whether its emulator is still around
+    int fd = create ? shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600) : -1;
+    if (fd < 0 && (!create || errno == EEXIST)) fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) return nullptr;
+
+    if (create && ftruncate(fd, sizeof(SharedSegment)) != 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void *address = mmap(nullptr, sizeof(SharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return address == MAP_FAILED ? nullptr : static_cast<SharedSegment *>(address);
+#else
+    (void) name;
+    (void) create;
+    return nullptr;
+#endif
+}
+
+// pid of this process, what SharedSegment::writer holds while it publishes
+static uint32_t own_pid() {
+#if CHIP8LER_SHM
+    return uint32_t(getpid());
+#else
+    return 1;
+#endif
+}
+
+static bool process_alive(uint32_t pid) {
+#if CHIP8LER_SHM
+    // EPERM means it is there but belongs to someone else
+    return kill(pid_t(pid), 0) == 0 || errno == EPERM;
+#else
+    (void) pid;
+    return false;
+#endif
+}
+
+static void unmap_segment(SharedSegment *segment) {
+#if CHIP8LER_SHM
+    munmap(segment, sizeof(SharedSegment));
+#else
+    (void) segment;
+#endif
+}
+
+SharedWriter::SharedWriter() : segment(nullptr) {}
+
+SharedWriter::~SharedWriter() {
+    Close();
+}
+
+bool SharedWriter::Open(const std::string &name) {
+    Close();
+
+    segment = map_segment(name, true);
+    if (!segment) {
+        std::cerr << "Failed to create shared memory: " << name << std::endl;
+        return false;
+    }
+    this->name = name;
+
+    // older layouts kept something else in `writer`, those are stale whatever it says.
+    // A magic of 0 is a segment another emulator is still setting up
+    uint32_t owner = segment->writer.load(std::memory_order_acquire);
+    bool other_layout = segment->magic && (segment->magic != SHARED_MAGIC || segment->version != SHARED_VERSION);
+    bool taken = owner && !other_layout && process_alive(owner);
+    if (taken || !segment->writer.compare_exchange_strong(owner, own_pid())) {
+        std::cerr << "Failed to create shared memory, another emulator is publishing into it: " << name << std::endl;
+        unmap_segment(segment);
+        segment = nullptr;
+        return false;
+    }
+
+    // a segment left behind by an emulator that crashed is taken over as it is. If it
+    // died inside Publish the sequence is still odd, so it is rounded up to the next
+    // even one and readers still mapping it stop waiting for a write that never ends
+    uint32_t sequence = segment->sequence.load(std::memory_order_relaxed);
+    segment->sequence.store((sequence + 1) & ~1u, std::memory_order_relaxed);
+    segment->version = SHARED_VERSION;
+    segment->size = sizeof(SharedSegment);
+    segment->keys.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = SHARED_MAGIC;
+    return true;
+}
+
+void SharedWriter::Close() {
+    if (!segment) return;
+
+    // nobody takes the segment over while this process lives, so it is still ours
+    // unless something wrote over `writer`. Only then is the name ours to remove
+    if (segment->writer.load(std::memory_order_relaxed) == own_pid()) {
+#if CHIP8LER_SHM
+        // mappings readers still hold stay valid, the name is free for the next emulator
+        shm_unlink(name.c_str());
+#endif
+        segment->writer.store(0, std::memory_order_release);
+    }
+
+    unmap_segment(segment);
+    segment = nullptr;
+}
+
+bool SharedWriter::IsOpen() const {
+    return segment;
+}
+
+void SharedWriter::Publish(const Chip8State &state) {
+    SharedFrame &frame = segment->frame;
+    uint32_t sequence = segment->sequence.load(std::memory_order_relaxed);
+
+    segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    frame.frame++;
+    memcpy(frame.display, state.display, sizeof(frame.display));
+    memcpy(frame.stack, state.stack, sizeof(frame.stack));
+    memcpy(frame.V, state.V, sizeof(frame.V));
+    frame.I = state.I;
+    frame.pc = state.pc;
+    frame.keys = state.keys;
+    frame.opcode = state.opcode;
+    frame.sp = state.sp;
+    frame.dt = state.dt;
+    frame.st = state.st;
+    frame.hires = state.hires;
+
+    segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+uint16_t SharedWriter::Keys() const {
+    return segment->keys.load(std::memory_order_relaxed);
+}
+
+SharedReader::SharedReader() : segment(nullptr) {}
+
+SharedReader::~SharedReader() {
+    Close();
+}
+
+bool SharedReader::Open(const std::string &name) {
+    Close();
+
+    segment = map_segment(name, false);
+    if (!segment) {
+        std::cerr << "Failed to open shared memory, is chip8ler running with --shared? " << name << std::endl;
+        return false;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (segment->magic != SHARED_MAGIC || segment->version != SHARED_VERSION || segment->size != sizeof(SharedSegment)) {
+        std::cerr << "Failed to open shared memory, unsupported version: " << name << std::endl;
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void SharedReader::Close() {
+    if (!segment) return;
+
+    unmap_segment(segment);
+    segment = nullptr;
+}
+
+bool SharedReader::WriterAttached() const {
+    return segment->writer.load(std::memory_order_acquire);
+}
+
+uint64_t SharedReader::Latest() const {
+    uint32_t sequence;
+    uint64_t frame;
+    do {
+        frame = Peek(sequence).frame;
+    } while (!Validate(sequence));
+    return frame;
+}
+
+const SharedFrame &SharedReader::Peek(uint32_t &sequence) const {
+    // a write takes a couple of microseconds, not worth sleeping on
+    while ((sequence = segment->sequence.load(std::memory_order_acquire)) & 0x1)
+        std::this_thread::yield();
+    return segment->frame;
+}
+
+bool SharedReader::Validate(uint32_t sequence) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return segment->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+void SharedReader::Read(SharedFrame &frame) const {
+    uint32_t sequence;
+    do {
+        memcpy(&frame, &Peek(sequence), sizeof(frame));
+    } while (!Validate(sequence));
+}
+
+void SharedReader::SetKey(uint8_t key, bool pressed) {
+    if (pressed)
+        segment->keys.fetch_or(0x1 << key, std::memory_order_relaxed);
+    else
+        segment->keys.fetch_and(~(0x1 << key), std::memory_order_relaxed);
+}
+
+void SharedReader::SetKeys(uint16_t keys) {
+    segment->keys.store(keys, std::memory_order_relaxed);
+}
@@ -0,0 +1,101 @@
+#ifndef CHIP8LER__SHAREDMEMORY_HPP_
+#define CHIP8LER__SHAREDMEMORY_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "Chip8.hpp"
+
+#define SHARED_MAGIC 0x48533843  // "C8SH"
+#define SHARED_VERSION 2
+#define SHARED_DEFAULT_NAME "/chip8ler"  // POSIX shared memory names start with a slash
+
+// what readers get to see of the machine after a frame
+struct SharedFrame {
+    uint64_t frame;  // counts up with every frame published, starting at 1
+    uint64_t display[HIRES_DISPLAY_HEIGHT][HIRES_DISPLAY_WIDTH / 64];  // as in Chip8State
+    uint16_t stack[STACK_SIZE];
+    uint8_t V[16];
+    uint16_t I;
+    uint16_t pc;
+    uint16_t keys;    // as the machine saw them during the frame
+    uint16_t opcode;  // last executed instruction
+    uint8_t sp;
+    uint8_t dt;
+    uint8_t st;
+    uint8_t hires;
+};
+
+// The segment as mapped by every process. The emulator is the only writer of `frame`,
+// guarded by a seqlock: `sequence` is odd while it is being written, so readers copy it
+// out and retry if the sequence changed under them. Readers only ever write `keys`.
+struct SharedSegment {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t size;  // of the whole segment
+    std::atomic<uint32_t> writer;  // pid of the emulator publishing into the segment, 0 once it closed
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint16_t> keys;    // bit n for key n, held down by readers
+    SharedFrame frame;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint16_t>::is_always_lock_free,
+              "atomics in shared memory must not hide a lock inside one process");
+
+// Emulator side. Creates the segment, removed again on Close. A segment another running
+// emulator publishes into is left alone, one whose emulator died is taken over
+class SharedWriter {
+ public:
+    SharedWriter();
+    ~SharedWriter();
+
+    SharedWriter(const SharedWriter &) = delete;
+    SharedWriter &operator=(const SharedWriter &) = delete;
+
+    bool Open(const std::string &name = SHARED_DEFAULT_NAME);
+    void Close();
+    bool IsOpen() const;
+
+    // once per frame on the emulation thread
+    void Publish(const Chip8State &state);
+    uint16_t Keys() const;
+
+ private:
+    std::string name;
+    SharedSegment *segment;
+};
+
+// Reader library for other local processes, which needs neither SDL nor the emulator.
+// Peek and Validate look at the frame in place without copying it, Read copies it out.
+class SharedReader {
+ public:
+    SharedReader();
+    ~SharedReader();
+
+    SharedReader(const SharedReader &) = delete;
+    SharedReader &operator=(const SharedReader &) = delete;
+
+    bool Open(const std::string &name = SHARED_DEFAULT_NAME);
+    void Close();
+
+    // false once the emulator went away, the last frame stays readable
+    bool WriterAttached() const;
+    // the frame number of the latest frame, cheap enough to poll for new ones
+    uint64_t Latest() const;
+
+    // waits out a write in progress, then returns the frame and the sequence to hand to
+    // Validate. Whatever was read from the frame is only consistent if Validate agrees
+    const SharedFrame &Peek(uint32_t &sequence) const;
+    bool Validate(uint32_t sequence) const;
+    void Read(SharedFrame &frame) const;
+
+    void SetKey(uint8_t key, bool pressed);
+    void SetKeys(uint16_t keys);
+
+ private:
+    SharedSegment *segment;
+};
+
+#endif //CHIP8LER__SHAREDMEMORY_HPP_
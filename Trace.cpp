@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "Trace.hpp"
+
+// registers before the instruction come from `previous`, after it from `record`
+#define LOG_V(r, n) "V" << int(n) << " (0x" << int((r).V[n]) << ")"
+#define LOG_I(r) "I (0x" << int((r).I) << ")"
+#define LOG_DT(r) "DT (0x" << int((r).dt) << ")"
+#define LOG_ST(r) "ST (0x" << int((r).st) << ")"
+#define LOG_CHANGED std::endl << "\t→ "
+
+Tracer::Tracer() : running(false), head(0), tail(0), last() {}
+
+Tracer::~Tracer() {
+    Close();
+}
+
+bool Tracer::Open(const std::string &path) {
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open trace file: " << path << std::endl;
+        return false;
+    }
+
+    TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord)};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    running = true;
+    writer = std::thread(&Tracer::Drain, this);
+    return true;
+}
+
+void Tracer::Close() {
+    if (!writer.joinable()) return;
+
+    running.store(false, std::memory_order_release);
+    writer.join();
+    file.close();
+}
+
+void Tracer::Push(TraceRecord record) {
+    record.changed = 0;
+    for (int i = 0; i < 16; i++) {
+        if (record.V[i] != last.V[i]) record.changed |= 1 << i;
+    }
+
+    if (record.I != last.I) record.flags |= TRACE_I;
+    if (record.dt != last.dt) record.flags |= TRACE_DT;
+    if (record.st != last.st) record.flags |= TRACE_ST;
+    if (record.sp != last.sp) record.flags |= TRACE_SP;
+    last = record;
+
+    uint32_t position = head.load(std::memory_order_relaxed);
+    while (position - tail.load(std::memory_order_acquire) == TRACE_RING_SIZE)
+        std::this_thread::yield();
+
+    ring[position & (TRACE_RING_SIZE - 1)] = record;
+    head.store(position + 1, std::memory_order_release);
+}
+
+void Tracer::Drain() {
+    for (;;) {
+        // check for shutdown before looking at head, so nothing pushed before Close is lost
+        bool stopping = !running.load(std::memory_order_acquire);
+        uint32_t position = tail.load(std::memory_order_relaxed);
+        uint32_t available = head.load(std::memory_order_acquire) - position;
+
+        if (!available) {
+            if (stopping) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        // write up to the end of the ring in one go
+        uint32_t start = position & (TRACE_RING_SIZE - 1);
+        uint32_t count = std::min(available, TRACE_RING_SIZE - start);
+        file.write(reinterpret_cast<const char *>(&ring[start]), count * sizeof(TraceRecord));
+        tail.store(position + count, std::memory_order_release);
+    }
+
+    file.flush();
+}
+
+void DescribeTrace(std::ostream &out, const TraceRecord &previous, const TraceRecord &record) {
+    const TraceRecord &p = previous;
+    const TraceRecord &r = record;
+
+    uint16_t opcode = r.opcode;
+    uint16_t nnn = opcode & 0x0FFF;
+    uint8_t n = opcode & 0x0F;
+    uint8_t x = opcode >> 8 & 0x0F;
+    uint8_t y = opcode >> 4 & 0x0F;
+    uint8_t kk = opcode & 0xFF;
+
+    out << std::hex << std::uppercase;
+    out << "pc:0x" << r.pc << " opcode:0x" << opcode << " inst:";
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if (kk == 0xE0) out << "CLS";
+            else if (kk == 0xEE) out << "RET";
+            else if (y == 0xC) out << "SCD " << int(n);
+            else if (kk == 0xFB) out << "SCR";
+            else if (kk == 0xFC) out << "SCL";
+            else if (kk == 0xFD) out << "EXIT";
+            else if (kk == 0xFE) out << "LOW";
+            else if (kk == 0xFF) out << "HIGH";
+            break;
+        case 0x1000:
+            out << "JP " << "0x" << nnn;
+            break;
+        case 0x2000:
+            out << "CALL " << "0x" << nnn;
+            break;
+        case 0x3000:
+            out << "SE " << LOG_V(p, x) << ", " << "0x" << int(kk);
+            break;
+        case 0x4000:
+            out << "SNE " << LOG_V(p, x) << ", " << "0x" << int(kk);
+            break;
+        case 0x5000:
+            out << "SE " << LOG_V(p, x) << ", " << LOG_V(p, y);
+            break;
+        case 0x6000:
+            out << "LD " << LOG_V(p, x) << ", " << "0x" << int(kk) << LOG_CHANGED << LOG_V(r, x);
+            break;
+        case 0x7000:
+            out << "ADD " << LOG_V(p, x) << ", " << "0x" << int(kk) << LOG_CHANGED << LOG_V(r, x);
+            break;
+        case 0x8000: {
+            static const char *names[16] = {
+                "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr,
+            };
+            if (!names[n]) break;
+
+            out << names[n] << " " << LOG_V(p, x) << ", " << LOG_V(p, y) << LOG_CHANGED << LOG_V(r, x);
+            if (n >= 0x4) out << ", " << LOG_V(r, 0xF);
+            break;
+        }
+        case 0x9000:
+            out << "SNE " << LOG_V(p, x) << ", " << LOG_V(p, y) << LOG_CHANGED << LOG_V(r, x);
+            break;
+        case 0xA000:
+            out << "LD " << LOG_I(p) << ", " << "0x" << nnn << LOG_CHANGED << LOG_I(r);
+            break;
+        case 0xB000:
+            out << "JP " << LOG_V(p, 0) << ", " << "0x" << nnn;
+            break;
+        case 0xC000:
+            out << "RND " << LOG_V(p, x) << ", " << "0x" << int(kk) << LOG_CHANGED << LOG_V(r, x);
+            break;
+        case 0xD000:
+            out << "DRW " << LOG_V(p, x) << ", " << LOG_V(p, y) << ", " << int(n) << LOG_CHANGED << LOG_V(r, 0xF);
+            break;
+        case 0xE000:
+            if (kk == 0x9E) out << "SKP " << LOG_V(p, x);
+            else if (kk == 0xA1) out << "SKNP " << LOG_V(p, x);
+            break;
+        case 0xF000:
+            switch (kk) {
+                case 0x07:
+                    out << "LD " << LOG_V(p, x) << ", " << LOG_DT(r) << LOG_CHANGED << LOG_V(r, x);
+                    break;
+                case 0x0A:
+                    out << "LD " << LOG_V(p, x) << ", K";
+                    if (r.keys) out << " (" << int(r.V[x]) << ")" << LOG_CHANGED << LOG_V(r, x);
+                    break;
+                case 0x15:
+                    out << "LD " << LOG_DT(r) << ", " << LOG_V(p, x) << LOG_CHANGED << "DT (0x" << int(r.V[x]) << ")";
+                    break;
+                case 0x18:
+                    out << "LD " << LOG_ST(r) << ", " << LOG_V(p, x) << LOG_CHANGED << "ST (0x" << int(r.V[x]) << ")";
+                    break;
+                case 0x1E:
+                    out << "ADD " << LOG_I(p) << ", " << LOG_V(p, x) << LOG_CHANGED << LOG_I(r) << ", " << LOG_V(r, 0xF);
+                    break;
+                case 0x29:
+                    out << "LD F, " << LOG_V(p, x) << LOG_CHANGED << LOG_I(r);
+                    break;
+                case 0x30:
+                    out << "LD HF, " << LOG_V(p, x) << LOG_CHANGED << LOG_I(r);
+                    break;
+                case 0x33:
+                    out << "LD B, " << LOG_V(p, x) << LOG_CHANGED << "MEMORY[" << LOG_I(r) << "] ("
+                        << int(p.V[x] / 100) << ", " << int(p.V[x] / 10 % 10) << ", " << int(p.V[x] % 10) << ")";
+                    break;
+                case 0x55:
+                    out << "LD [I], V" << int(x) << LOG_CHANGED << "MEMORY[" << LOG_I(p) << "] (";
+                    for (int i = 0; i <= x; i++) out << "0x" << int(p.V[i]) << ", ";
+                    out << "), " << LOG_I(r);
+                    break;
+                case 0x65:
+                    out << "LD V" << int(x) << ", [I]" << LOG_CHANGED << "V..." << int(x) << " (";
+                    for (int i = 0; i <= x; i++) out << "0x" << int(r.V[i]) << ", ";
+                    out << "), " << LOG_I(r);
+                    break;
+                case 0x75:
+                    out << "LD R, V" << int(x);
+                    break;
+                case 0x85:
+                    out << "LD V" << int(x) << ", R" << LOG_CHANGED << "V..." << int(x) << " (";
+                    for (int i = 0; i <= std::min<int>(x, 7); i++) out << "0x" << int(r.V[i]) << ", ";
+                    out << ")";
+                    break;
+            }
+            break;
+    }
+
+    out << std::endl;
+}
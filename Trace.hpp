@@ -0,0 +1,77 @@
+#ifndef CHIP8LER__TRACE_HPP_
+#define CHIP8LER__TRACE_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <thread>
+
+#define TRACE_MAGIC 0x52543843  // "C8TR"
+#define TRACE_VERSION 1
+#define TRACE_RING_SIZE (1 << 16)  // records, must be a power of two
+
+// record flags
+#define TRACE_SNAPSHOT 0x01  // machine state before the first traced instruction
+#define TRACE_I 0x02
+#define TRACE_DT 0x04
+#define TRACE_ST 0x08
+#define TRACE_SP 0x10
+
+// machine state after one instruction, except for the timers which are stored as the
+// instruction saw them. `changed` and `flags` say which registers differ from the
+// previous record
+struct TraceRecord {
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;
+    uint16_t changed;   // bit n set when Vn changed
+    uint16_t keys;
+    uint8_t flags;
+    uint8_t sp;
+    uint8_t dt;
+    uint8_t st;
+    uint8_t V[16];
+    uint8_t reserved[2];
+};
+
+static_assert(sizeof(TraceRecord) == 32, "trace records are written to disk as is");
+
+struct TraceHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+};
+
+// Single producer ring of trace records, drained to a file by a background thread.
+// The emulation thread only blocks when the writer falls a whole ring behind.
+class Tracer {
+ public:
+    Tracer();
+    ~Tracer();
+
+    bool Open(const std::string &path);
+    void Close();
+
+    void Push(TraceRecord record);
+
+ private:
+    std::ofstream file;
+    std::thread writer;
+    std::atomic<bool> running;
+
+    TraceRecord ring[TRACE_RING_SIZE];
+    std::atomic<uint32_t> head;  // written by the emulation thread
+    std::atomic<uint32_t> tail;  // written by the writer thread
+
+    TraceRecord last;  // previous record, to work out what changed
+
+    void Drain();
+};
+
+// prints `record` in the same format the interpreter used to print while running.
+// `previous` holds the registers from before the instruction
+void DescribeTrace(std::ostream &out, const TraceRecord &previous, const TraceRecord &record);
+
+#endif //CHIP8LER__TRACE_HPP_
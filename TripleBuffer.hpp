@@ -0,0 +1,46 @@
+#ifndef CHIP8LER__TRIPLEBUFFER_HPP_
+#define CHIP8LER__TRIPLEBUFFER_HPP_
+
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest value from one producer thread to one consumer thread without either
+// of them ever waiting. The producer fills Back() and publishes it, the consumer picks up
+// whatever was published last and skips anything it was too slow to see.
+template <class T>
+class TripleBuffer {
+ public:
+    // producer side
+    T &Back() {
+        return buffers[back];
+    }
+
+    void Publish() {
+        uint8_t previous = middle.exchange(back | kFresh, std::memory_order_acq_rel);
+        back = previous & kIndex;
+    }
+
+    // consumer side, true when a newer value than Front() was published
+    bool Acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & kFresh)) return false;
+
+        uint8_t previous = middle.exchange(front, std::memory_order_acq_rel);
+        front = previous & kIndex;
+        return true;
+    }
+
+    const T &Front() const {
+        return buffers[front];
+    }
+
+ private:
+    static constexpr uint8_t kIndex = 0x3;
+    static constexpr uint8_t kFresh = 0x4;  // set in `middle` while it holds an unread value
+
+    T buffers[3] = {};
+    std::atomic<uint8_t> middle{1};
+    uint8_t back = 0;   // only touched by the producer
+    uint8_t front = 2;  // only touched by the consumer
+};
+
+#endif //CHIP8LER__TRIPLEBUFFER_HPP_
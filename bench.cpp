@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Args.hpp"
+#include "Chip8.hpp"
+#include "Chip8Batch.hpp"
+#include "Display.hpp"
+#include "ForkArena.hpp"
+#include "Json.hpp"
+
+// Runs every rom in the bundled corpus headlessly with the same scripted input and
+// reports how fast it went as JSON, so results can be compared between commits.
+
+#define BENCH_DEFAULT_CYCLES 2000000
+#define BENCH_DEFAULT_REPEATS 3    // timed runs per rom, the fastest one is reported
+#define BENCH_SLICE 1000           // instructions between changes to the scripted input
+#define BENCH_DEFAULT_THRESHOLD 10 // percent slower than the baseline that counts as a regression
+#define BENCH_DECODE_ROUNDS 2000
+#define BENCH_BLIT_CYCLES 2000000
+#define BENCH_PRESENT_FRAMES 2000
+#define BENCH_FORK_ROUNDS 2000
+#define BENCH_FORK_CHILDREN 64
+#define BENCH_BATCH_CYCLES 200000  // per lane
+
+using Clock = std::chrono::steady_clock;
+
+static const char *rom_directories[] = {"games", "demos", "programs"};
+
+struct RomResult {
+    std::string name;
+    uint64_t instructions;
+    double instructions_per_second;
+    double ns_per_instruction;
+    uint64_t draws;
+    double draw_ms;
+};
+
+struct BatchResult {
+    std::string name;
+    double scalar_ips;  // lane instructions per second, summed over every lane
+    double batch_ips;
+    double vector_share;  // of the lane instructions, run by the vector kernels
+    double alone_share;   // of the lane instructions, run with lockstep set aside
+    uint32_t mismatched;  // lanes that did not end in the same state as their scalar run
+};
+
+struct MicroResult {
+    double decode_ns_per_instruction;
+    double blit_ns_per_sprite;
+    double present_us_per_frame;
+    double fork_ns_per_clone;
+};
+
+static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// the same input for every rom and every run: keys go down and up in turn
+static void run_scripted(Chip8 &chip_8, uint64_t cycles) {
+    uint64_t done = 0;
+    for (uint32_t slice = 0; done < cycles; slice++) {
+        chip_8.SetKey(slice / 8 % 16, slice / 4 % 2);
+        done += chip_8.RunCycles(std::min<uint64_t>(BENCH_SLICE, cycles - done));
+    }
+}
+
+static bool bench_rom(const std::string &path, uint64_t cycles, int repeats, bool use_recompiler, RomResult &result) {
+    result.name = std::filesystem::path(path).parent_path().filename().string() + "/"
+        + std::filesystem::path(path).filename().string();
+
+    // timed passes, nothing but the emulator itself. The fastest is the one least
+    // disturbed by everything else running on the machine
+    double seconds = 0;
+    for (int i = 0; i < repeats; i++) {
+        Chip8 timed;
+        if (!timed.LoadRom(path)) return false;
+        timed.SetTimerMode(TimerMode::kVirtual);
+        if (use_recompiler) timed.EnableRecompiler();
+
+        auto start = Clock::now();
+        run_scripted(timed, cycles);
+        double elapsed = seconds_since(start);
+        if (i == 0 || elapsed < seconds) seconds = elapsed;
+    }
+
+    // second pass through the stats hook, which times every draw and so is kept out of the numbers above
+    Chip8 counted;
+    counted.LoadRom(path);
+    counted.SetTimerMode(TimerMode::kVirtual);
+    counted.EnableStats(true);
+    run_scripted(counted, cycles);
+
+    result.instructions = cycles;
+    result.instructions_per_second = cycles / seconds;
+    result.ns_per_instruction = seconds * 1e9 / cycles;
+    result.draws = counted.GetStats().draws;
+    result.draw_ms = counted.GetStats().draw_nanoseconds / 1e6;
+    return true;
+}
+
+// each lane presses its own key in turn, so lanes drift apart wherever the rom reads input
+static uint8_t batch_key(uint32_t slice, uint32_t lane) {
+    return (slice / 8 + lane) % 16;
+}
+
+// `lanes` separate Chip8s against one Chip8Batch of that many lanes, both given the same
+// input. The batch has to end with every lane where its Chip8 did
+static bool bench_batch(const std::string &path, uint32_t lane_count, uint64_t cycles, BatchResult &result) {
+    result.name = std::filesystem::path(path).parent_path().filename().string() + "/"
+        + std::filesystem::path(path).filename().string();
+
+    std::vector<std::unique_ptr<Chip8>> scalar;
+    for (uint32_t lane = 0; lane < lane_count; lane++) {
+        scalar.emplace_back(new Chip8());
+        if (!scalar.back()->LoadRom(path)) return false;
+        scalar.back()->SetTimerMode(TimerMode::kVirtual);
+    }
+
+    Chip8Batch batch(lane_count);
+    if (!batch.LoadRom(path)) return false;
+
+    auto start = Clock::now();
+    for (uint64_t done = 0, slice = 0; done < cycles; done += BENCH_SLICE, slice++) {
+        for (uint32_t lane = 0; lane < lane_count; lane++) {
+            scalar[lane]->SetKey(batch_key(slice, lane), slice / 4 % 2);
+            scalar[lane]->RunCycles(std::min<uint64_t>(BENCH_SLICE, cycles - done));
+        }
+    }
+    double scalar_seconds = seconds_since(start);
+
+    start = Clock::now();
+    for (uint64_t done = 0, slice = 0; done < cycles; done += BENCH_SLICE, slice++) {
+        for (uint32_t lane = 0; lane < lane_count; lane++)
+            batch.SetKey(lane, batch_key(slice, lane), slice / 4 % 2);
+        batch.RunCycles(std::min<uint64_t>(BENCH_SLICE, cycles - done));
+    }
+    double batch_seconds = seconds_since(start);
+
+    const BatchStats &stats = batch.GetStats();
+    result.scalar_ips = cycles * lane_count / scalar_seconds;
+    result.batch_ips = cycles * lane_count / batch_seconds;
+    result.vector_share = double(stats.vector_instructions) / (stats.vector_instructions + stats.lane_instructions);
+    result.alone_share = double(stats.alone_instructions) / (stats.vector_instructions + stats.lane_instructions);
+    result.mismatched = 0;
+    for (uint32_t lane = 0; lane < lane_count; lane++)
+        result.mismatched += !batch.SameState(lane, *scalar[lane]);
+    return true;
+}
+
+static void write_batch_json(std::ostream &out, uint32_t lanes, uint64_t cycles, const std::vector<BatchResult> &roms) {
+    out << "{\n";
+    out << "  \"lanes\": " << lanes << ",\n";
+    out << "  \"cycles\": " << cycles << ",\n";
+    out << "  \"roms\": [\n";
+    for (size_t i = 0; i < roms.size(); i++) {
+        const BatchResult &rom = roms[i];
+        out << "    {\"name\": " << JsonString(rom.name)
+            << ", \"scalar_ips\": " << uint64_t(rom.scalar_ips)
+            << ", \"batch_ips\": " << uint64_t(rom.batch_ips)
+            << ", \"speedup\": " << rom.batch_ips / rom.scalar_ips
+            << ", \"vector_share\": " << rom.vector_share
+            << ", \"alone_share\": " << rom.alone_share
+            << ", \"mismatched_lanes\": " << rom.mismatched << "}"
+            << (i + 1 < roms.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+// restores between two states that differ on every memory page, so each restore
+// decodes the whole address space again
+static double bench_decode() {
+    Chip8 chip_8;
+    Chip8State a = chip_8.GetState();
+    Chip8State b = a;
+    for (int i = 0; i < MEMORY_SIZE; i++) {
+        a.memory[i] = i * 7;
+        b.memory[i] = i * 13 + 1;
+    }
+
+    auto start = Clock::now();
+    for (int i = 0; i < BENCH_DECODE_ROUNDS; i++)
+        chip_8.SetState(i % 2 ? a : b);
+    return seconds_since(start) * 1e9 / (BENCH_DECODE_ROUNDS * MEMORY_SIZE / 2.0);
+}
+
+// a loop that draws a 15 row sprite, moving it across the screen
+static double bench_blit() {
+    static const uint8_t program[] = {
+        0x60, 0x00,  // LD V0, 0
+        0xA0, 0x00,  // LD I, 0
+        0xD0, 0x1F,  // DRW V0, V1, 15
+        0x70, 0x03,  // ADD V0, 3
+        0x71, 0x01,  // ADD V1, 1
+        0x12, 0x04,  // JP 0x204
+    };
+
+    Chip8 chip_8;
+    Chip8State state = chip_8.GetState();
+    memcpy(state.memory + PROGRAM_START, program, sizeof(program));
+    chip_8.SetState(state);
+    chip_8.SetTimerMode(TimerMode::kVirtual);
+    chip_8.EnableStats(true);
+
+    chip_8.RunCycles(BENCH_BLIT_CYCLES);
+    const ExecStats &stats = chip_8.GetStats();
+    return stats.draws ? double(stats.draw_nanoseconds) / stats.draws : 0;
+}
+
+// the children of one machine cloned and released again, as a tree search does it
+static double bench_fork() {
+    Chip8 chip_8;
+    ForkArena arena;
+    uint32_t root = arena.Capture(chip_8);
+    uint32_t children[BENCH_FORK_CHILDREN];
+
+    auto start = Clock::now();
+    for (int round = 0; round < BENCH_FORK_ROUNDS; round++) {
+        for (uint32_t &child : children)
+            child = arena.Clone(root);
+        for (uint32_t child : children)
+            arena.Release(child);
+    }
+    return seconds_since(start) * 1e9 / (BENCH_FORK_ROUNDS * BENCH_FORK_CHILDREN);
+}
+
+// every row changes on every frame, on SDL's offscreen driver so no window is needed
+static double bench_present() {
+    setenv("SDL_VIDEODRIVER", "dummy", 0);
+
+    Chip8 chip_8;
+    Frame frames[2] = {};
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        frames[0].display[y][0] = 0xAAAAAAAAAAAAAAAAull >> (y % 2);
+        frames[1].display[y][0] = ~frames[0].display[y][0];
+    }
+
+    Display display(&chip_8, "chip8ler_bench");
+
+    auto start = Clock::now();
+    for (int i = 0; i < BENCH_PRESENT_FRAMES; i++)
+        display.Draw(frames[i % 2]);
+    return seconds_since(start) * 1e6 / BENCH_PRESENT_FRAMES;
+}
+
+static void write_json(std::ostream &out, uint64_t cycles, bool use_recompiler,
+                       const std::vector<RomResult> &roms, const MicroResult &micro) {
+    double total_seconds = 0;
+    uint64_t total_instructions = 0;
+    for (const RomResult &rom : roms) {
+        total_seconds += rom.instructions / rom.instructions_per_second;
+        total_instructions += rom.instructions;
+    }
+
+    out << "{\n";
+    out << "  \"cycles\": " << cycles << ",\n";
+    out << "  \"backend\": \"" << (use_recompiler ? "recompiler" : "interpreter") << "\",\n";
+    out << "  \"roms\": [\n";
+    for (size_t i = 0; i < roms.size(); i++) {
+        const RomResult &rom = roms[i];
+        out << "    {\"name\": " << JsonString(rom.name)
+            << ", \"ips\": " << uint64_t(rom.instructions_per_second)
+            << ", \"ns_per_instruction\": " << rom.ns_per_instruction
+            << ", \"draws\": " << rom.draws
+            << ", \"draw_ms\": " << rom.draw_ms << "}"
+            << (i + 1 < roms.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n";
+    out << "  \"total_ips\": " << uint64_t(total_seconds > 0 ? total_instructions / total_seconds : 0) << ",\n";
+    out << "  \"micro\": {\"decode_ns_per_instruction\": " << micro.decode_ns_per_instruction
+        << ", \"blit_ns_per_sprite\": " << micro.blit_ns_per_sprite
+        << ", \"present_us_per_frame\": " << micro.present_us_per_frame
+        << ", \"fork_ns_per_clone\": " << micro.fork_ns_per_clone << "}\n";
+    out << "}\n";
+}
+
+// reads the rom lines of a file written by write_json, name -> instructions per second
+static bool read_baseline(const std::string &path, std::map<std::string, double> &ips) {
+    std::map<std::string, std::string> values;
+    if (!ReadBaseline(path, "ips", values)) return false;
+
+    for (const auto &value : values)
+        ips[value.first] = std::strtod(value.second.c_str(), nullptr);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    uint64_t cycles = BENCH_DEFAULT_CYCLES;
+    int repeats = BENCH_DEFAULT_REPEATS;
+    bool use_recompiler = false;
+    bool run_micro = true;
+    std::string rom_root = "roms";
+    std::string output_path;
+    std::string baseline_path;
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+    uint32_t batch_lanes = 0;
+    bool cycles_given = false;
+
+    for (int i = 1; i < argc; i++) {
+        bool parsed = true;
+        if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], cycles);
+            cycles_given = true;
+        } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], repeats);
+            repeats = std::max(repeats, 1);
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            use_recompiler = true;
+        } else if (strcmp(argv[i], "--no-micro") == 0) {
+            run_micro = false;
+        } else if (strcmp(argv[i], "--roms") == 0 && i + 1 < argc) {
+            rom_root = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], threshold);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], batch_lanes);
+            batch_lanes = std::max(batch_lanes, 1u);
+        } else {
+            parsed = false;
+        }
+
+        if (!parsed) {
+            std::cout << "Usage: chip8ler_bench [--cycles <n>] [--repeat <n>] [--jit] [--no-micro] [--roms <dir>] [--output <json_file>]" << std::endl;
+            std::cout << "                      [--baseline <json_file> [--threshold <percent>]]" << std::endl;
+            std::cout << "       chip8ler_bench --batch <lanes> [--cycles <n>] [--roms <dir>] [--output <json_file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::string> paths;
+    for (const char *directory : rom_directories) {
+        std::error_code error;
+        for (const auto &entry : std::filesystem::directory_iterator(rom_root + "/" + directory, error)) {
+            if (entry.path().extension() == ".ch8") paths.push_back(entry.path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    if (paths.empty()) {
+        std::cerr << "Failed to find any roms under " << rom_root << std::endl;
+        return 1;
+    }
+
+    if (batch_lanes) {
+        if (!cycles_given) cycles = BENCH_BATCH_CYCLES;
+
+        std::vector<BatchResult> results;
+        for (const std::string &path : paths) {
+            BatchResult result;
+            if (!bench_batch(path, batch_lanes, cycles, result)) continue;
+            std::cerr << result.name << ": " << result.batch_ips / result.scalar_ips << "x" << std::endl;
+            results.push_back(result);
+        }
+
+        if (output_path.empty()) {
+            write_batch_json(std::cout, batch_lanes, cycles, results);
+            return 0;
+        }
+
+        std::ofstream file(output_path);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open output: " << output_path << std::endl;
+            return 1;
+        }
+        write_batch_json(file, batch_lanes, cycles, results);
+        return 0;
+    }
+
+    std::vector<RomResult> roms;
+    for (const std::string &path : paths) {
+        RomResult result;
+        if (!bench_rom(path, cycles, repeats, use_recompiler, result)) continue;
+        std::cerr << result.name << ": " << uint64_t(result.instructions_per_second) << " ips" << std::endl;
+        roms.push_back(result);
+    }
+
+    MicroResult micro = {};
+    if (run_micro) {
+        micro.decode_ns_per_instruction = bench_decode();
+        micro.blit_ns_per_sprite = bench_blit();
+        micro.present_us_per_frame = bench_present();
+        micro.fork_ns_per_clone = bench_fork();
+    }
+
+    if (output_path.empty()) {
+        write_json(std::cout, cycles, use_recompiler, roms, micro);
+    } else {
+        std::ofstream file(output_path);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open output: " << output_path << std::endl;
+            return 1;
+        }
+        write_json(file, cycles, use_recompiler, roms, micro);
+    }
+
+    if (baseline_path.empty()) return 0;
+
+    // regression mode, every rom has to stay within the threshold of the baseline
+    std::map<std::string, double> baseline;
+    if (!read_baseline(baseline_path, baseline)) return 1;
+
+    int regressions = 0;
+    for (const RomResult &rom : roms) {
+        auto previous = baseline.find(rom.name);
+        if (previous == baseline.end() || previous->second <= 0) continue;
+
+        double change = (rom.instructions_per_second / previous->second - 1) * 100;
+        if (change < -threshold) {
+            std::cerr << "REGRESSION " << rom.name << ": " << uint64_t(previous->second) << " -> "
+                      << uint64_t(rom.instructions_per_second) << " ips (" << change << "%)" << std::endl;
+            regressions++;
+        }
+    }
+
+    std::cerr << regressions << " regression(s) beyond " << threshold << "%" << std::endl;
+    return regressions ? 2 : 0;
+}
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "Args.hpp"
+#include "Capture.hpp"
+
+// one binary PBM per frame at the frame's own resolution, `prefix`_000001.pbm and so on
+static bool write_pbm_sequence(CaptureReader &reader, const std::string &prefix) {
+    Frame frame;
+    uint64_t microseconds;
+    for (uint64_t index = 1; reader.Next(frame, microseconds); index++) {
+        std::ostringstream path;
+        path << prefix << "_" << std::setw(6) << std::setfill('0') << index << ".pbm";
+
+        std::ofstream out(path.str(), std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Failed to write image: " << path.str() << std::endl;
+            return false;
+        }
+
+        int width = frame.hires ? HIRES_DISPLAY_WIDTH : DISPLAY_WIDTH;
+        int height = frame.hires ? HIRES_DISPLAY_HEIGHT : DISPLAY_HEIGHT;
+        out << "P4\n" << width << " " << height << "\n";
+        for (int y = 0; y < height; y++) {
+            // PBM rows are packed the same way as the display, leftmost pixel in the top bit
+            for (int byte = 0; byte < width / 8; byte++)
+                out.put(char(frame.display[y][byte / 8] >> (56 - byte % 8 * 8) & 0xFF));
+        }
+    }
+
+    return true;
+}
+
+// Converts a capture written by `chip8ler --capture` into an animated GIF or a sequence of
+// images, or describes it
+int main(int argc, char **argv) {
+    std::string gif_path;
+    std::string pbm_prefix;
+    int scale = 4;
+
+    bool parsed = argc >= 2;
+    for (int i = 2; i < argc && parsed; i++) {
+        if (strcmp(argv[i], "--gif") == 0 && i + 1 < argc) {
+            gif_path = argv[++i];
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], scale);
+            scale = std::max(1, std::min(scale, 32));
+        } else if (strcmp(argv[i], "--pbm") == 0 && i + 1 < argc) {
+            pbm_prefix = argv[++i];
+        }
+    }
+
+    if (!parsed) {
+        std::cout << "Usage: chip8ler_capturedump <capture_file> [--gif <gif_file> [--scale <n>] | --pbm <output_prefix>]" << std::endl;
+        return 1;
+    }
+
+    CaptureReader reader;
+    if (!reader.Open(argv[1])) return 1;
+
+    if (!gif_path.empty()) {
+        std::ofstream out(gif_path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open() || !WriteCaptureGif(reader, out, scale)) {
+            std::cerr << "Failed to write gif: " << gif_path << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!pbm_prefix.empty()) {
+        return write_pbm_sequence(reader, pbm_prefix) ? 0 : 1;
+    }
+
+    Frame frame;
+    uint64_t microseconds = 0;
+    uint64_t frames = 0;
+    while (reader.Next(frame, microseconds)) frames++;
+
+    const CaptureHeader &header = reader.Header();
+    std::cout << frames << " frames over " << microseconds / 1000000.0 << " s, "
+              << header.dropped << " dropped while recording" << std::endl;
+    if (frames != header.frames)
+        std::cout << "the capture was not closed properly, " << header.frames << " frames in the header" << std::endl;
+    return 0;
+}
@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Args.hpp"
+#include "Chip8.hpp"
+#include "Hash.hpp"
+#include "Json.hpp"
+#include "MappedFile.hpp"
+#include "Movie.hpp"
+#include "SessionHost.hpp"
+
+// Runs every rom of a list or a directory tree without a window, spread over all cores,
+// and reports the screen each one ends on as a hash plus how fast it got there. Meant for
+// checking the whole corpus against the hashes of a known good build. With --sessions it
+// instead hosts that many live sessions in real time and reports how well they kept up.
+
+#define HEADLESS_DEFAULT_FRAMES 3600  // a minute of emulated time
+#define HEADLESS_DEFAULT_IPS 1000     // instructions per emulated second
+#define HEADLESS_DEFAULT_SECONDS 10   // of hosting sessions
+#define HEADLESS_KEY_PERIOD_MS 100    // keys pressed and released in turn on every session
+
+using Clock = std::chrono::steady_clock;
+
+struct RunResult {
+    std::string name;
+    bool loaded;
+    uint64_t hash;  // of the final screen, see HashDisplay
+    uint64_t instructions;
+    uint64_t frames;
+    double seconds;
+    uint16_t pc;
+    bool hires;
+};
+
+static std::string hex(uint64_t value) {
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << value;
+    return out.str();
+}
+
+// runs by frames at `ips`, or by instructions when `cycles` is set, and never looks at the keys
+static void run_rom(const std::string &path, uint64_t frames, uint64_t cycles, uint32_t ips, RunResult &result) {
+    Chip8 chip_8;
+    result.loaded = chip_8.LoadRom(path);
+    if (!result.loaded) return;
+
+    chip_8.SetTimerMode(TimerMode::kVirtual);
+    chip_8.SetClockSpeed(ips);
+
+    auto start = Clock::now();
+    if (cycles) {
+        while (result.instructions < cycles)
+            result.instructions += chip_8.RunCycles(std::min<uint64_t>(cycles - result.instructions, ips));
+    } else {
+        for (; result.frames < frames; result.frames++)
+            result.instructions += chip_8.RunFrame();
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    const Chip8State &state = chip_8.GetState();
+    result.hash = HashDisplay(state, FNV_OFFSET_BASIS);
+    result.pc = state.pc;
+    result.hires = state.hires;
+}
+
+static void write_json(std::ostream &out, uint64_t frames, uint64_t cycles, uint32_t ips, unsigned threads,
+                       double seconds, const std::vector<RunResult> &results) {
+    out << "{\n";
+    out << "  \"frames\": " << (cycles ? 0 : frames) << ",\n";
+    out << "  \"cycles\": " << cycles << ",\n";
+    out << "  \"ips\": " << ips << ",\n";
+    out << "  \"threads\": " << threads << ",\n";
+    out << "  \"seconds\": " << seconds << ",\n";
+    out << "  \"roms\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const RunResult &result = results[i];
+        out << "    {\"name\": " << JsonString(result.name)
+            << ", \"hash\": \"" << hex(result.hash) << "\""
+            << ", \"instructions\": " << result.instructions
+            << ", \"frames\": " << result.frames
+            << ", \"run_ips\": " << uint64_t(result.seconds > 0 ? result.instructions / result.seconds : 0)
+            << ", \"pc\": " << result.pc
+            << ", \"hires\": " << (result.hires ? "true" : "false") << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+// reads the rom lines of a file written by write_json, name -> hash
+static bool read_baseline(const std::string &path, std::map<std::string, uint64_t> &hashes) {
+    std::map<std::string, std::string> values;
+    if (!ReadBaseline(path, "hash", values)) return false;
+
+    for (const auto &value : values)
+        hashes[value.first] = std::strtoull(value.second.c_str(), nullptr, 16);
+    return true;
+}
+
+// Hosts `count` sessions taking turns through the roms for `seconds` of wall time, pressing
+// keys and taking frames the way clients would, then writes every session's counters
+static int run_sessions(const std::vector<std::string> &paths, uint32_t count, double seconds, uint32_t ips,
+                        unsigned threads, std::ostream &out) {
+    std::vector<std::unique_ptr<MappedFile>> roms;
+    for (const std::string &path : paths) {
+        roms.push_back(std::make_unique<MappedFile>());
+        if (!roms.back()->Open(path)) {
+            std::cerr << "Failed to load rom: " << path << std::endl;
+            return 1;
+        }
+    }
+
+    SessionHost host(threads);
+    std::vector<uint32_t> ids;
+    for (uint32_t i = 0; i < count; i++) {
+        const MappedFile &rom = *roms[i % roms.size()];
+        uint32_t id = host.Open(rom.Data(), rom.Size(), ips);
+        if (!id) {
+            std::cerr << "Failed to open a session for " << paths[i % paths.size()] << std::endl;
+            return 1;
+        }
+        ids.push_back(id);
+    }
+
+    host.Start();
+    auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    uint64_t presented = 0;
+    for (uint32_t step = 0; Clock::now() < end; step++) {
+        for (uint32_t id : ids) {
+            host.SetKey(id, step / 2 % 16, step % 2 == 0);
+            while (host.TakeFrame(id)) presented++;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(HEADLESS_KEY_PERIOD_MS));
+    }
+    host.Stop();
+
+    SessionStats total = {};
+    out << "{\n";
+    out << "  \"sessions\": " << count << ",\n";
+    out << "  \"threads\": " << threads << ",\n";
+    out << "  \"seconds\": " << seconds << ",\n";
+    out << "  \"ips\": " << ips << ",\n";
+    out << "  \"sessions_stats\": [\n";
+    for (size_t i = 0; i < ids.size(); i++) {
+        SessionStats stats;
+        host.GetStats(ids[i], stats);
+        total.frames += stats.frames;
+        total.deadline_misses += stats.deadline_misses;
+        total.cpu_ns += stats.cpu_ns;
+        total.max_late_ns = std::max(total.max_late_ns, stats.max_late_ns);
+        total.steals += stats.steals;
+
+        out << "    {\"name\": " << JsonString(paths[i % paths.size()])
+            << ", \"frames\": " << stats.frames
+            << ", \"deadline_misses\": " << stats.deadline_misses
+            << ", \"cpu_ms\": " << stats.cpu_ns / 1e6
+            << ", \"max_late_ms\": " << stats.max_late_ns / 1e6
+            << ", \"steals\": " << stats.steals << "}"
+            << (i + 1 < ids.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n";
+    out << "  \"frames\": " << total.frames << ",\n";
+    out << "  \"deadline_misses\": " << total.deadline_misses << ",\n";
+    out << "  \"cpu_ms\": " << total.cpu_ns / 1e6 << ",\n";
+    out << "  \"max_late_ms\": " << total.max_late_ns / 1e6 << "\n";
+    out << "}\n";
+
+    std::cerr << count << " session(s) on " << threads << " thread(s): " << total.frames << " frames, "
+              << total.deadline_misses << " missed their deadline, " << presented << " presented, "
+              << total.cpu_ns / 1e9 / seconds * 100 << "% of a core busy" << std::endl;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    uint64_t frames = HEADLESS_DEFAULT_FRAMES;
+    uint64_t cycles = 0;
+    uint32_t ips = HEADLESS_DEFAULT_IPS;
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::string output_path;
+    std::string baseline_path;
+    std::vector<std::string> inputs;
+    uint32_t session_count = 0;
+    double host_seconds = HEADLESS_DEFAULT_SECONDS;
+
+    for (int i = 1; i < argc; i++) {
+        bool parsed = true;
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], frames);
+        } else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], cycles);
+        } else if (strcmp(argv[i], "--ips") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], ips);
+            ips = std::max(ips, 1u);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], threads);
+            threads = std::max(threads, 1u);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], session_count);
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], host_seconds);
+        } else if (argv[i][0] == '-') {
+            parsed = false;
+        } else {
+            inputs.emplace_back(argv[i]);
+        }
+
+        if (!parsed) {
+            inputs.clear();
+            break;
+        }
+    }
+
+    if (inputs.empty()) {
+        std::cout << "Usage: chip8ler_headless [--frames <n> | --cycles <n>] [--ips <n>] [--threads <n>] [--output <json_file>]" << std::endl;
+        std::cout << "                         [--baseline <json_file>] (<rom_file> | <rom_directory>)..." << std::endl;
+        std::cout << "       chip8ler_headless --sessions <n> [--seconds <s>] [--ips <n>] [--threads <n>] [--output <json_file>]" << std::endl;
+        std::cout << "                         (<rom_file> | <rom_directory>)..." << std::endl;
+        return 1;
+    }
+
+    // directories are searched all the way down, files are taken as they are
+    std::vector<std::string> paths;
+    for (const std::string &input : inputs) {
+        std::error_code error;
+        if (!std::filesystem::is_directory(input, error)) {
+            paths.push_back(input);
+            continue;
+        }
+        for (std::filesystem::recursive_directory_iterator it(input, error), end; !error && it != end; it.increment(error)) {
+            if (it->is_regular_file() && it->path().extension() == ".ch8") paths.push_back(it->path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    if (paths.empty()) {
+        std::cerr << "Failed to find any roms" << std::endl;
+        return 1;
+    }
+
+    if (session_count) {
+        if (output_path.empty()) return run_sessions(paths, session_count, host_seconds, ips, threads, std::cout);
+
+        std::ofstream file(output_path);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open output: " << output_path << std::endl;
+            return 1;
+        }
+        return run_sessions(paths, session_count, host_seconds, ips, threads, file);
+    }
+
+    // every worker takes the next rom until there are none left, roms take very different
+    // times so handing them out one at a time keeps all cores busy to the end
+    std::vector<RunResult> results(paths.size());
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < paths.size(); i = next++) {
+            results[i] = {paths[i], false, 0, 0, 0, 0, 0, false};
+            run_rom(paths[i], frames, cycles, ips, results[i]);
+        }
+    };
+
+    auto start = Clock::now();
+    std::vector<std::thread> workers;
+    threads = std::min<size_t>(threads, paths.size());
+    for (unsigned i = 0; i < threads; i++)
+        workers.emplace_back(work);
+    for (std::thread &worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    int failed = 0;
+    for (const RunResult &result : results) {
+        if (!result.loaded) failed++;
+    }
+    results.erase(std::remove_if(results.begin(), results.end(), [](const RunResult &result) { return !result.loaded; }),
+                  results.end());
+
+    if (output_path.empty()) {
+        write_json(std::cout, frames, cycles, ips, threads, seconds, results);
+    } else {
+        std::ofstream file(output_path);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open output: " << output_path << std::endl;
+            return 1;
+        }
+        write_json(file, frames, cycles, ips, threads, seconds, results);
+    }
+
+    std::cerr << results.size() << " rom(s) in " << seconds << " s on " << threads << " thread(s)";
+    if (failed) std::cerr << ", " << failed << " failed to load";
+    std::cerr << std::endl;
+
+    if (baseline_path.empty()) return failed ? 1 : 0;
+
+    // validation mode, every rom in the baseline has to end on the same screen
+    std::map<std::string, uint64_t> baseline;
+    if (!read_baseline(baseline_path, baseline)) return 1;
+
+    int mismatches = 0;
+    for (const RunResult &result : results) {
+        auto expected = baseline.find(result.name);
+        if (expected == baseline.end()) continue;
+
+        if (expected->second != result.hash) {
+            std::cerr << "MISMATCH " << result.name << ": " << hex(expected->second) << " -> " << hex(result.hash) << std::endl;
+            mismatches++;
+        }
+    }
+
+    std::cerr << mismatches << " mismatch(es) against the baseline" << std::endl;
+    return mismatches || failed ? 2 : 0;
+}
@@ -1,66 +1,468 @@
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <iomanip>
 #include <iostream>
 #include <string>
 #include <thread>
-#include <chrono>
+#include <vector>
+#include <cstring>
 
+#include "Args.hpp"
+#include "Audio.hpp"
+#include "Capture.hpp"
 #include "Chip8.hpp"
+#include "Debugger.hpp"
 #include "Display.hpp"
+#include "Emulator.hpp"
+#include "Latency.hpp"
+#include "Movie.hpp"
+#include "Profile.hpp"
+#include "RomCatalog.hpp"
+#include "Scheduler.hpp"
+#include "SharedMemory.hpp"
 
-#define CLOCK_SPEED 500 // CHIP8 should be 500Hz, SuperCHIP should be 1000hz
+// set from a signal handler, SIGUSR1 asks for the profile so far
+static std::atomic<bool> profile_signalled(false);
 
-using Clock=std::chrono::system_clock;
+static void on_profile_signal(int) {
+    profile_signalled = true;
+}
+
+// SIGINT and SIGTERM end a run without a window
+static std::atomic<bool> stop_signalled(false);
+
+static void on_stop_signal(int) {
+    stop_signalled = true;
+}
 
 void draw_display_cout(Chip8 *chip_8) {
-    for (auto & rows : chip_8->display) {
-        for (uint8_t point : rows) {
-            std::cout << (point ? "#" : " ");
+    for (int y = 0; y < chip_8->GetDisplayHeight(); y++) {
+        for (int x = 0; x < chip_8->GetDisplayWidth(); x++) {
+            std::cout << (chip_8->GetPixel(x, y) ? "#" : " ");
         }
         std::cout << std::endl;
     }
 }
 
+// Runs every rom through the interpreter and the recompiler side by side with the same
+// input, comparing the whole machine after every slice. Returns the number of mismatches.
+int run_lockstep(const std::vector<std::string> &roms, long cycles) {
+    int mismatches = 0;
+
+    for (const std::string &rom : roms) {
+        Chip8 interpreter, recompiled;
+        if (!interpreter.LoadRom(rom) || !recompiled.LoadRom(rom)) {
+            mismatches++;
+            continue;
+        }
+
+        interpreter.SetTimerMode(TimerMode::kVirtual);
+        recompiled.SetTimerMode(TimerMode::kVirtual);
+
+        if (!recompiled.EnableRecompiler()) {
+            std::cerr << "The recompiler is not supported on this platform" << std::endl;
+            return 1;
+        }
+
+        long done = 0;
+        bool same = true;
+        for (uint32_t slice = 0; same && done < cycles; slice++) {
+            // uneven slice lengths so blocks also get cut off by the budget
+            uint32_t length = 1 + slice * 37 % 251;
+            uint8_t key = slice / 64 % 16;
+            bool pressed = slice / 32 % 2;
+            interpreter.SetKey(key, pressed);
+            recompiled.SetKey(key, pressed);
+
+            interpreter.RunCycles(length);
+            recompiled.RunCycles(length);
+
+            done += length;
+            same = interpreter.SameState(recompiled);
+        }
+
+        if (same) {
+            std::cout << "OK " << rom << std::endl;
+        } else {
+            std::cout << "MISMATCH " << rom << " after " << std::dec << done << " cycles" << std::endl;
+            mismatches++;
+        }
+    }
+
+    return mismatches;
+}
+
+// Presses and releases keys in turn on a fixed schedule without opening a window,
+// counting a frame as presented as soon as it is taken. Only keys the rom has been seen
+// checking are pressed once there are any. Returns non-zero if no key press made it to
+// the screen.
+int run_latency_test(const std::string &rom, SchedulerMode mode, uint32_t clock_speed, uint32_t presses) {
+    using Clock = std::chrono::steady_clock;
+
+    Chip8 chip_8;
+    if (!chip_8.LoadRom(rom)) return 1;
+
+    LatencyProbe probe;
+    chip_8.AttachLatencyProbe(&probe);
+
+    Emulator emulator(&chip_8, nullptr, rom + ".state", &probe);
+    emulator.Start(mode, clock_speed, false);
+
+    // give up on roms that ignore most keys rather than wait forever
+    auto limit = Clock::now() + std::chrono::milliseconds(presses * 2 * LATENCY_TIMEOUT_MS);
+    auto next = Clock::now();
+    uint8_t key = 0;
+    for (uint32_t step = 0; probe.Completed() < presses && Clock::now() < limit;) {
+        if (Clock::now() >= next) {
+            if (step % 2 == 0) {
+                uint16_t polled = probe.PolledKeys();
+                do key = (key + 1) % 16; while (polled && !(polled >> key & 0x1));
+            }
+
+            probe.KeyEvent();
+            chip_8.SetKey(key, step % 2 == 0);
+            step++;
+            next += std::chrono::milliseconds(100);
+        }
+
+        if (const Frame *frame = emulator.TakeFrame())
+            probe.Presented(frame->number);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    emulator.Stop();
+
+    std::cout << rom << std::endl;
+    probe.Print(std::cout);
+    return probe.Completed() ? 0 : 1;
+}
+
+// Plays a recorded movie back headless as fast as possible. Returns non-zero if it
+// could not be played or the screen went somewhere else than it did when recording.
+int run_replay(const std::string &movie, const std::string &rom) {
+    ReplayResult result;
+    if (!ReplayMovie(movie, rom, result)) return 1;
+
+    std::cout << rom << ": " << result.frames << " frames in " << result.seconds << " s ("
+              << long(result.frames / std::max(result.seconds, 1e-9)) << " frames/s)" << std::endl;
+    if (result.first_mismatch != result.frames) {
+        std::cout << "MISMATCH at frame " << result.first_mismatch << std::endl;
+        return 1;
+    }
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
+
+// Lets the emulator run until it is told to stop, for runs without a window that are
+// watched and driven through shared memory or only recorded
+void run_headless(Emulator *emulator) {
+    std::signal(SIGINT, on_stop_signal);
+    std::signal(SIGTERM, on_stop_signal);
+
+    while (!stop_signalled) {
+        if (profile_signalled.exchange(false))
+            emulator->RequestProfileDump();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(WAIT_TIMEOUT_MS));
+    }
+}
+
+// Reads debugger commands from stdin until quit or end of input, see Debugger::Help. The
+// machine runs on this thread in virtual time, SIGINT stops a continue that would not end
+int run_debug(Chip8 *chip_8) {
+    std::signal(SIGINT, on_stop_signal);
+    chip_8->SetTimerMode(TimerMode::kVirtual);
+
+    Debugger debugger(chip_8);
+    debugger.SetInterrupt(&stop_signalled);
+
+    std::string line;
+    std::cout << "(chip8ler) " << std::flush;
+    while (std::getline(std::cin, line)) {
+        stop_signalled = false;
+        if (!debugger.Command(line, std::cout)) break;
+        std::cout << "(chip8ler) " << std::flush;
+    }
+    return 0;
+}
+
+void list_catalog(const RomCatalog &catalog) {
+    for (const RomInfo &rom : catalog.Roms()) {
+        std::cout << std::hex << std::setw(16) << std::setfill('0') << rom.hash << std::dec << std::setfill(' ')
+                  << " " << std::setw(5) << rom.size << "  " << rom.path;
+        if (!rom.author.empty()) std::cout << "  (" << rom.author << (rom.year.empty() ? "" : ", " + rom.year) << ")";
+        std::cout << std::endl;
+    }
+}
+
+// always 1, the exit code for a command line that did not make sense
+static int print_usage() {
+    std::cout << "Usage: chip8ler [--schip | --ips <n> | --turbo] [--quirks vip|chip48|schip] [--stats] [--latency] [--audio-buffer <samples>]" << std::endl;
+    std::cout << "                [--jit] [--trace <trace_file>]" << std::endl;
+    std::cout << "                [--profile <output_prefix>] [--record <movie_file>] [--seed <n>]" << std::endl;
+    std::cout << "                [--capture <capture_file>] [--shared <shm_name>] [--headless] <rom_file>" << std::endl;
+    std::cout << "       chip8ler [--schip | --ips <n>] [--quirks vip|chip48|schip] [--seed <n>] --debug <rom_file>" << std::endl;
+    std::cout << "       chip8ler --replay <movie_file> <rom_file>" << std::endl;
+    std::cout << "       chip8ler --lockstep <cycles> <rom_file>..." << std::endl;
+    std::cout << "       chip8ler [--schip | --ips <n>] --latency-test <presses> <rom_file>" << std::endl;
+    std::cout << "       chip8ler [--catalog <dir>] [--rescan] (--list | --hash <fnv1a> [<options>])" << std::endl;
+    return 1;
+}
+
 int main(int argc, char **argv) {
     bool running = true;
+    bool use_recompiler = false;
+    long lockstep_cycles = 0;
+    std::string trace_path;
+    SchedulerMode mode = SchedulerMode::kAccurate;
+    uint32_t clock_speed = CHIP8_CLOCK_SPEED;
+    bool show_stats = false;
+    uint16_t audio_buffer = AUDIO_DEFAULT_BUFFER;
+    bool measure_latency = false;
+    uint32_t latency_presses = 0;
+    std::vector<std::string> roms;
+    std::string catalog_path = CATALOG_DEFAULT_DIRECTORY;
+    bool rescan = false;
+    bool list = false;
+    uint64_t rom_hash = 0;
+    std::string profile_prefix;
+    std::string record_path;
+    std::string replay_path;
+    uint64_t seed = DEFAULT_RNG_SEED;
+    std::string shared_name;
+    std::string capture_path;
+    bool headless = false;
+    bool debug = false;
+    bool set_quirks = false;
+    QuirkPreset quirks = QuirkPreset::kCosmacVip;
 
-    if (argc < 2) {
-        std::cout << "Usage: chip8ler <rom_file>" << std::endl;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--jit") == 0) {
+            use_recompiler = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--schip") == 0) {
+            mode = SchedulerMode::kAccurate;
+            clock_speed = SUPERCHIP_CLOCK_SPEED;
+            if (!set_quirks) quirks = QuirkPreset::kSuperChip;
+            set_quirks = true;
+        } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+            if (!ParseQuirkPreset(argv[++i], quirks)) {
+                std::cerr << "Unknown quirks " << argv[i] << ", expected vip, chip48 or schip" << std::endl;
+                return 1;
+            }
+            set_quirks = true;
+        } else if (strcmp(argv[i], "--ips") == 0 && i + 1 < argc) {
+            mode = SchedulerMode::kCustom;
+            if (!ParseArg(argv[++i], clock_speed)) return print_usage();
+        } else if (strcmp(argv[i], "--turbo") == 0) {
+            mode = SchedulerMode::kTurbo;
+        } else if (strcmp(argv[i], "--audio-buffer") == 0 && i + 1 < argc) {
+            if (!ParseArg(argv[++i], audio_buffer)) return print_usage();
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = true;
+        } else if (strcmp(argv[i], "--latency") == 0) {
+            measure_latency = true;
+        } else if (strcmp(argv[i], "--latency-test") == 0 && i + 1 < argc) {
+            if (!ParseArg(argv[++i], latency_presses)) return print_usage();
+        } else if (strcmp(argv[i], "--lockstep") == 0 && i + 1 < argc) {
+            if (!ParseArg(argv[++i], lockstep_cycles)) return print_usage();
+        } else if (strcmp(argv[i], "--catalog") == 0 && i + 1 < argc) {
+            catalog_path = argv[++i];
+        } else if (strcmp(argv[i], "--rescan") == 0) {
+            rescan = true;
+        } else if (strcmp(argv[i], "--list") == 0) {
+            list = true;
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_prefix = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            if (!ParseArg(argv[++i], seed)) return print_usage();
+        } else if (strcmp(argv[i], "--shared") == 0 && i + 1 < argc) {
+            shared_name = argv[++i];
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--debug") == 0) {
+            debug = true;
+        } else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+            if (!ParseArg(argv[++i], rom_hash, 16)) return print_usage();
+        } else {
+            roms.emplace_back(argv[i]);
+        }
+    }
+
+    // roms looked up by hash come straight out of the catalog's mapping
+    RomCatalog catalog;
+    const RomInfo *catalog_rom = nullptr;
+    if (list || rom_hash || rescan) {
+        if (!catalog.Open(catalog_path, rescan)) return 1;
+        if (list) {
+            list_catalog(catalog);
+            return 0;
+        }
+    }
+    if (rom_hash) {
+        catalog_rom = catalog.Find(rom_hash);
+        if (!catalog_rom) {
+            std::cerr << "Failed to find rom " << std::hex << rom_hash << " in " << catalog_path << std::endl;
+            return 1;
+        }
+        roms.insert(roms.begin(), catalog_path + "/" + catalog_rom->path);
+    }
+
+    if (roms.empty()) {
+        return print_usage();
+    }
+
+    if (lockstep_cycles > 0) {
+        return run_lockstep(roms, lockstep_cycles) ? 1 : 0;
+    }
+
+    std::string rom_path = roms[0];
+
+    if (latency_presses > 0) {
+        return run_latency_test(rom_path, mode, clock_speed, latency_presses);
+    }
+
+    if (!replay_path.empty()) {
+        return run_replay(replay_path, rom_path);
+    }
+
+    auto *chip_8 = new Chip8();
+    if (catalog_rom ? !chip_8->LoadRom(catalog_rom->data, catalog_rom->size) : !chip_8->LoadRom(rom_path)) {
         return 1;
     }
 
-    std::string rom_path = argv[1];
+    // the quirk database picked some already, asking for others overrides it
+    if (set_quirks) chip_8->SetQuirks(quirks);
+
+    if (use_recompiler && !chip_8->EnableRecompiler()) {
+        std::cout << "The recompiler is not supported on this platform, using the interpreter" << std::endl;
+    }
 
-    auto *chip_8 = new Chip8(true);
-    if (!chip_8->LoadRom(rom_path)) {
+    if (!trace_path.empty() && !chip_8->StartTrace(trace_path)) {
+        return 1;
+    }
+
+    // driven from stdin instead of a window, on this thread
+    if (debug) {
+        chip_8->SetSeed(seed);
+        chip_8->SetClockSpeed(clock_speed);
+        return run_debug(chip_8);
+    }
+
+    // the seed goes into the movie so a replay draws the same random numbers
+    chip_8->SetSeed(seed);
+    MovieRecorder recorder;
+    if (!record_path.empty() && !recorder.Open(record_path, rom_path, seed)) {
+        return 1;
+    }
+
+    // dumped on SIGUSR1 and on exit
+    if (!profile_prefix.empty()) {
+        chip_8->EnableProfiler(true);
+#ifdef SIGUSR1
+        std::signal(SIGUSR1, on_profile_signal);
+#endif
+    }
+
+    // framebuffer and registers for other processes, see SharedMemory.hpp
+    SharedWriter shared;
+    if (!shared_name.empty() && !shared.Open(shared_name)) {
+        return 1;
+    }
+
+    // every presented frame, see chip8ler_capturedump to turn it into a gif
+    CaptureWriter capture;
+    if (!capture_path.empty() && !capture.Open(capture_path)) {
         return 1;
     }
 
     std::cout << "Starting " << rom_path << std::endl;
 
-    auto *display = new Display(chip_8, rom_path.c_str());
+    // no window, no sound and no SDL at all without one
+    Display *display = nullptr;
+    Audio *audio = nullptr;
+    if (!headless) {
+        display = new Display(chip_8, rom_path.c_str());
+        audio = new Audio(audio_buffer);
+    }
 
-    std::chrono::system_clock::time_point stamp;
+    // key to screen timings, dumped with F2 and on exit
+    LatencyProbe *probe = nullptr;
+    if (measure_latency) {
+        probe = new LatencyProbe();
+        chip_8->AttachLatencyProbe(probe);
+        if (display) display->SetLatencyProbe(probe);
+    }
 
-    while (running) {
-        stamp = Clock::now();
+    // emulation runs on its own thread from here on, this one only presents and handles input
+    auto *emulator = new Emulator(chip_8, audio, rom_path + ".state", probe);
+    emulator->SetProfileOutput(profile_prefix, rom_path);
+    if (recorder.IsOpen()) emulator->SetRecorder(&recorder);
+    if (shared.IsOpen()) emulator->SetSharedWriter(&shared);
+    if (capture.IsOpen()) emulator->SetCapture(&capture);
+    emulator->Start(mode, clock_speed, show_stats, headless ? nullptr : &Display::Wake);
 
-        chip_8->Cycle();
+    if (headless) run_headless(emulator);
 
-        // Draw to display
-        if (chip_8->ShouldUpdateDisplay()) {
-            display->Draw();
-        }
+    while (running && !headless) {
+        display->HandleInput(running);
+        emulator->SetRewinding(display->IsRewinding());
 
-        // TODO: implement buzz
-        if (chip_8->ShouldBuzz()) {
+        if (profile_signalled.exchange(false))
+            emulator->RequestProfileDump();
 
+        switch (display->TakeHotkey()) {
+            case Hotkey::kSaveState:
+                emulator->RequestSave();
+                break;
+            case Hotkey::kLoadState:
+                emulator->RequestLoad();
+                break;
+            case Hotkey::kLatencyReport:
+                if (probe) probe->Print(std::cout);
+                break;
+            case Hotkey::kNone:
+                break;
         }
 
-        display->HandleInput(running);
+        // presenting waits for vblank, which paces this loop while frames keep coming
+        if (const Frame *frame = emulator->TakeFrame()) {
+            display->Draw(*frame);
+        } else {
+            // nothing to draw, sleep until a key or the next frame rather than poll
+            display->WaitForEvent(WAIT_TIMEOUT_MS);
+        }
+    }
+
+    emulator->Stop();
+    shared.Close();
+    capture.Close();
+
+    if (recorder.IsOpen()) {
+        recorder.Close();
+        std::cout << "Recorded " << record_path << std::endl;
+    }
+
+    if (chip_8->GetProfiler() && chip_8->GetProfiler()->Write(profile_prefix, rom_path))
+        std::cout << "Wrote profile to " << profile_prefix << ".json and .folded" << std::endl;
 
-        long delta = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - stamp).count();
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000 / CLOCK_SPEED - delta));
+    if (probe) {
+        probe->Print(std::cout);
+        delete(probe);
     }
 
+    delete(emulator);
+    delete(audio);
     delete(display);
     delete(chip_8);
 
@@ -0,0 +1,79 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "Args.hpp"
+#include "SharedMemory.hpp"
+
+static void print_frame(const SharedFrame &frame) {
+    int width = frame.hires ? HIRES_DISPLAY_WIDTH : DISPLAY_WIDTH;
+    int height = frame.hires ? HIRES_DISPLAY_HEIGHT : DISPLAY_HEIGHT;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++)
+            std::cout << (frame.display[y][x / 64] >> (63 - x % 64) & 0x1 ? "#" : " ");
+        std::cout << std::endl;
+    }
+
+    std::cout << std::hex << "frame " << std::dec << frame.frame << std::hex << "  pc " << frame.pc << "  I " << frame.I
+              << "  opcode " << frame.opcode << "  dt " << int(frame.dt) << "  st " << int(frame.st)
+              << "  keys " << frame.keys << std::endl;
+    for (int i = 0; i < 16; i++)
+        std::cout << "V" << i << " " << int(frame.V[i]) << (i == 15 ? "\n" : "  ");
+    std::cout << std::dec;
+}
+
+// Shows the screen and registers of a chip8ler running with --shared, and presses keys in it
+int main(int argc, char **argv) {
+    std::string name = SHARED_DEFAULT_NAME;
+    bool watch = false;
+    int press = -1;
+    int hold_ms = 100;
+
+    for (int i = 1; i < argc; i++) {
+        bool parsed = true;
+        if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = true;
+        } else if (strcmp(argv[i], "--press") == 0 && i + 1 < argc) {
+            uint8_t key = 0;
+            parsed = ParseArg(argv[++i], key, 16) && key <= 0xF;
+            press = key;
+        } else if (strcmp(argv[i], "--hold") == 0 && i + 1 < argc) {
+            parsed = ParseArg(argv[++i], hold_ms);
+        } else {
+            parsed = false;
+        }
+
+        if (!parsed) {
+            std::cout << "Usage: chip8ler_sharedview [--name <shm_name>] [--press <key> [--hold <ms>]] [--watch]" << std::endl;
+            return 1;
+        }
+    }
+
+    SharedReader reader;
+    if (!reader.Open(name)) return 1;
+
+    if (press >= 0) {
+        reader.SetKey(press, true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(hold_ms));
+        reader.SetKey(press, false);
+    }
+
+    SharedFrame frame;
+    uint64_t shown = 0;
+    do {
+        uint64_t latest = reader.Latest();
+        if (latest != shown) {
+            reader.Read(frame);
+            shown = frame.frame;
+            print_frame(frame);
+        }
+
+        if (watch) std::this_thread::sleep_for(std::chrono::milliseconds(1000 / TIMER_FREQUENCY));
+    } while (watch && reader.WriterAttached());
+
+    return 0;
+}
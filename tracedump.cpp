@@ -0,0 +1,36 @@
+#include <iostream>
+#include <fstream>
+
+#include "Trace.hpp"
+
+// Prints a binary trace written by `chip8ler --trace` in human readable form
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cout << "Usage: chip8ler_tracedump <trace_file>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open trace file: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    TraceHeader header = {};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (header.magic != TRACE_MAGIC || header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+        std::cerr << "Not a chip8ler trace: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    TraceRecord previous = {};
+    TraceRecord record;
+    while (file.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+        if (!(record.flags & TRACE_SNAPSHOT))
+            DescribeTrace(std::cout, previous, record);
+
+        previous = record;
+    }
+
+    return 0;
+}